@@ -1,14 +1,28 @@
-#include <iostream> // For std::cin, std::cout, std::cerr
+#include <iostream> // For std::cerr
 #include <string>   // For std::string
 #include <cassert>
+#include <cctype>
+#include <charconv>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <vector>
 
 // Include the B+ Tree header
 #include "src/BPT.h"
 
 #define BPT_TEST
 
-struct String64Hasher {
-  RFlowey::hash_t operator()(const RFlowey::string<64>& s) const {
+using Key = RFlowey::string<64>;
+
+struct KeyHasher {
+  RFlowey::hash_t operator()(const Key& s) const {
     return hash(s);
   }
 };
@@ -19,6 +33,278 @@ struct IntHasher {
   }
 };
 
+/**
+ * @brief stdin read in large blocks and split into whitespace separated tokens; a token is kept
+ * in a reused string, so reading allocates nothing once the longest token has been seen
+ */
+class InputReader {
+  static constexpr size_t BLOCK = 1 << 20;
+  std::vector<char> block_ = std::vector<char>(BLOCK);
+  size_t pos_ = 0;
+  size_t size_ = 0;
+  std::string token_;
+
+  int get() {
+    if (pos_ == size_) {
+      size_ = std::fread(block_.data(), 1, BLOCK, stdin);
+      pos_ = 0;
+      if (size_ == 0) {
+        return EOF;
+      }
+    }
+    return static_cast<unsigned char>(block_[pos_++]);
+  }
+
+  /**
+   * @brief give back the character get() returned last, which is still in the block
+   */
+  void unget(int c) {
+    if (c != EOF) {
+      --pos_;
+    }
+  }
+
+public:
+  /**
+   * @return the next token, valid until the next call; false at the end of the input
+   */
+  bool token(std::string_view &out) {
+    int c = get();
+    while (c != EOF && std::isspace(c)) {
+      c = get();
+    }
+    if (c == EOF) {
+      return false;
+    }
+    token_.clear();
+    while (c != EOF && !std::isspace(c)) {
+      token_.push_back(static_cast<char>(c));
+      c = get();
+    }
+    //like operator>>, leave the delimiter, so that skip_line ends the line of this token
+    unget(c);
+    out = token_;
+    return true;
+  }
+
+  /**
+   * @brief read an int the way operator>> does: an optional sign and the digits after it,
+   * leaving whatever follows them to the next read
+   * @return false if there are no digits or the number does not fit in an int
+   */
+  bool number(int &out) {
+    int c = get();
+    while (c != EOF && std::isspace(c)) {
+      c = get();
+    }
+    bool negative = c == '-';
+    if (c == '-' || c == '+') {
+      c = get();
+    }
+    long long value = 0;
+    bool digits = false;
+    bool overflow = false;
+    while (c != EOF && std::isdigit(c)) {
+      digits = true;
+      value = value * 10 + (c - '0');
+      if (value > static_cast<long long>(std::numeric_limits<int>::max()) + 1) {
+        overflow = true;
+        value = 0;
+      }
+      c = get();
+    }
+    unget(c);
+    if (negative) {
+      value = -value;
+    }
+    if (!digits || overflow || value > std::numeric_limits<int>::max()) {
+      return false;
+    }
+    out = static_cast<int>(value);
+    return true;
+  }
+
+  void skip_line() {
+    int c = get();
+    while (c != EOF && c != '\n') {
+      c = get();
+    }
+  }
+};
+
+/**
+ * @brief stdout through a large buffer, numbers formatted with std::to_chars
+ */
+class OutputWriter {
+  static constexpr size_t BLOCK = 1 << 20;
+  std::vector<char> block_ = std::vector<char>(BLOCK);
+  size_t size_ = 0;
+
+  void reserve(size_t count) {
+    if (size_ + count > BLOCK) {
+      flush();
+    }
+  }
+
+public:
+  ~OutputWriter() {
+    flush();
+  }
+
+  void put(char c) {
+    reserve(1);
+    block_[size_++] = c;
+  }
+
+  void put(std::string_view text) {
+    reserve(text.size());
+    std::memcpy(block_.data() + size_, text.data(), text.size());
+    size_ += text.size();
+  }
+
+  void put(int value) {
+    reserve(16);
+    size_ = std::to_chars(block_.data() + size_, block_.data() + BLOCK, value).ptr - block_.data();
+  }
+
+  void flush() {
+    std::fwrite(block_.data(), 1, size_, stdout);
+    size_ = 0;
+  }
+};
+
+struct Command {
+  enum Op : char { INSERT, ERASE, FIND } op;
+  Key key;
+  int value;
+};
+
+/**
+ * @brief batches of parsed commands on their way from the parser to the executor. With a spare
+ * core the parser runs on a thread of its own, a few batches ahead; without one it fills a batch
+ * whenever the executor asks for the next.
+ */
+class CommandPipe {
+  static constexpr size_t BATCH = 4096;
+  static constexpr size_t AHEAD = 4;
+
+  InputReader &reader_;
+  int remaining_;
+  bool background_;
+  std::mutex mutex_;
+  std::condition_variable ready_;
+  std::condition_variable taken_;
+  std::deque<std::vector<Command>> batches_;
+  //batches handed back by the executor, refilled instead of allocated
+  std::vector<std::vector<Command>> free_;
+  bool done_ = false;
+  std::thread thread_;
+
+  bool key(Key &out) {
+    std::string_view text;
+    if (!reader_.token(text)) {
+      return false;
+    }
+    out = Key(text.data(), text.size());
+    return true;
+  }
+
+  /**
+   * @brief parse up to BATCH commands into batch
+   * @return false once the input ended or a command could not be read
+   */
+  bool parse(std::vector<Command> &batch) {
+    batch.clear();
+    while (remaining_ > 0 && batch.size() < BATCH) {
+      --remaining_;
+      std::string_view command;
+      if (!reader_.token(command)) {
+        std::cerr << "Error reading command." << std::endl;
+        return false;
+      }
+      Command next{};
+      if (command == "insert" || command == "delete") {
+        next.op = command == "insert" ? Command::INSERT : Command::ERASE;
+        //the key is taken before the next token reuses the storage of the command
+        if (!key(next.key) || !reader_.number(next.value)) {
+          std::cerr << "Error reading " << (next.op == Command::INSERT ? "insert" : "delete")
+                    << " arguments." << std::endl;
+          return false;
+        }
+      } else if (command == "find") {
+        next.op = Command::FIND;
+        if (!key(next.key)) {
+          std::cerr << "Error reading find argument." << std::endl;
+          return false;
+        }
+      } else {
+        std::cerr << "Invalid command: " << command << std::endl;
+        reader_.skip_line();
+        continue;
+      }
+      batch.push_back(next);
+    }
+    return remaining_ > 0;
+  }
+
+  void run() {
+    bool more = true;
+    while (more) {
+      std::vector<Command> batch;
+      {
+        std::unique_lock lock(mutex_);
+        taken_.wait(lock, [this] { return batches_.size() < AHEAD; });
+        if (!free_.empty()) {
+          batch.swap(free_.back());
+          free_.pop_back();
+        }
+      }
+      more = parse(batch);
+      std::lock_guard lock(mutex_);
+      batches_.push_back(std::move(batch));
+      done_ = !more;
+      ready_.notify_one();
+    }
+  }
+
+public:
+  CommandPipe(InputReader &reader, int count, bool background = std::thread::hardware_concurrency() > 1)
+    : reader_(reader), remaining_(count), background_(background) {
+    if (background_) {
+      thread_ = std::thread(&CommandPipe::run, this);
+    }
+  }
+
+  ~CommandPipe() {
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+  /**
+   * @brief replace batch, which the executor is done with, by the next batch of commands
+   * @return false if there are no more commands
+   */
+  bool next(std::vector<Command> &batch) {
+    if (!background_) {
+      if (done_) {
+        return false;
+      }
+      done_ = !parse(batch);
+      return true;
+    }
+    std::unique_lock lock(mutex_);
+    ready_.wait(lock, [this] { return !batches_.empty() || done_; });
+    if (batches_.empty()) {
+      return false;
+    }
+    free_.push_back(std::move(batch));
+    batch.swap(batches_.front());
+    batches_.pop_front();
+    taken_.notify_one();
+    return true;
+  }
+};
 
 bool TEST;
 
@@ -32,64 +318,82 @@ int main() {
 
   std::string bpt_data_file = "No2697.dat";
   //std::remove(bpt_data_file.c_str());
-  RFlowey::BPT<RFlowey::string<64>, int,String64Hasher,IntHasher> bpt(bpt_data_file);
+  std::optional<RFlowey::BPT<Key, int, KeyHasher, IntHasher>> tree;
+  try {
+    tree.emplace(bpt_data_file);
+  } catch (const std::runtime_error &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  auto &bpt = *tree;
 
+  InputReader reader;
   int n;
-  if (!(std::cin >> n)) {
+  if (!reader.number(n)) {
       std::cerr << "Error reading number of operations." << std::endl;
       return 1;
   }
 
-  for (int i = 0; i < n; ++i) {
-    std::string command;
-    if (!(std::cin >> command)) {
-        std::cerr << "Error reading command." << std::endl;
-        break;
+  OutputWriter out;
+  //runs of consecutive finds and inserts, executed as one batched call when the run ends
+  std::vector<Key> find_keys;
+  std::vector<std::vector<int>> found;
+  std::vector<Key> insert_keys;
+  std::vector<int> insert_values;
+  auto run_finds = [&] {
+    if (find_keys.empty()) {
+      return;
     }
-
-    if (command == "insert") {
-      std::string index_str;
-      int value;
-      if (!(std::cin >> index_str >> value)) {
-           std::cerr << "Error reading insert arguments." << std::endl;
-           break;
-      }
-      bpt.insert(index_str, value);
-    } else if (command == "delete") {
-      std::string index_str;
-      int value;
-       if (!(std::cin >> index_str >> value)) {
-           std::cerr << "Error reading delete arguments." << std::endl;
-           break;
-       }
-       bpt.erase(index_str,value);
-    } else if (command == "find") {
-      std::string index_str;
-       if (!(std::cin >> index_str)) {
-           std::cerr << "Error reading find argument." << std::endl;
-           break;
-       }
-      auto out = bpt.find(index_str);
-
-      if (out.empty()) {
-        std::cout << "null";
+    bpt.find_many(find_keys, found);
+    for (size_t i = 0; i < find_keys.size(); ++i) {
+      if (found[i].empty()) {
+        out.put("null");
       } else {
-        bool first = true;
-        for (const auto& val : out) {
-          if (!first) {
-            std::cout << ' ';
+        for (size_t j = 0; j < found[i].size(); ++j) {
+          if (j > 0) {
+            out.put(' ');
           }
-          std::cout << val;
-          first = false;
+          out.put(found[i][j]);
         }
       }
-      std::cout << '\n';
-    } else {
-      std::cerr << "Invalid command: " << command << std::endl;
-      std::string dummy;
-      std::getline(std::cin, dummy);
+      out.put('\n');
+    }
+    find_keys.clear();
+  };
+  auto run_inserts = [&] {
+    if (insert_keys.empty()) {
+      return;
+    }
+    bpt.insert_many(insert_keys, insert_values);
+    insert_keys.clear();
+    insert_values.clear();
+  };
+
+  CommandPipe pipe(reader, n);
+  std::vector<Command> batch;
+  while (pipe.next(batch)) {
+    for (const Command &command : batch) {
+      switch (command.op) {
+        case Command::INSERT:
+          run_finds();
+          insert_keys.push_back(command.key);
+          insert_values.push_back(command.value);
+          break;
+        case Command::ERASE:
+          run_finds();
+          run_inserts();
+          bpt.erase(command.key, command.value);
+          break;
+        case Command::FIND:
+          run_inserts();
+          find_keys.push_back(command.key);
+          break;
+      }
     }
-    //bpt.print_tree_structure();
   }
+  run_finds();
+  run_inserts();
+  out.flush();
+  bpt.dump_latency(std::cerr);
   return 0;
-}
\ No newline at end of file
+}
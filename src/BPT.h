@@ -1,13 +1,30 @@
 #pragma once
 #include <algorithm>
 #include <limits>
+#include <optional>
+#include <thread>
+#include <stdexcept>
+#include <type_traits>
+#include <typeinfo>
+#include <vector>
 
 
 #include "src/disk/IO_manager.h"
 #include "src/disk/IO_utils.h"
 #include "thirdparty/vector/vector.hpp"
 #include "src/utils/utils.h"
+#include "src/utils/latency.h"
 #include "Node.h"
+#include "message_buffer.h"
+#include "bloom.h"
+#include "result_cache.h"
+#ifdef BPT_SLOTTED_LEAF
+#include "slotted_leaf.h"
+#endif
+
+#if defined(BPT_MEMTABLE) && defined(BPT_MESSAGE_BUFFER)
+#error "BPT_MEMTABLE and BPT_MESSAGE_BUFFER are alternatives, define at most one"
+#endif
 
 namespace RFlowey {
   template<typename Key,typename Value,typename KeyHash = std::hash<Key>,typename ValueHash = std::hash<Value>>
@@ -17,8 +34,28 @@ namespace RFlowey {
   class BPT {
     using key_type = pair<hash_t,hash_t>;
     using value_type = pair<Key, Value>;
+#ifdef BPT_COMPACT_INNER
+    using InnerNode = BPTNode<packed_key, child_id_t, Inner>;
+    //every page id stored into an inner node goes through child()
+    static child_id_t child(page_id_t page_id) {
+      return to_child_id(page_id);
+    }
+#else
     using InnerNode = BPTNode<key_type, page_id_t, Inner>;
+    static page_id_t child(page_id_t page_id) {
+      return page_id;
+    }
+#endif
+#ifdef BPT_SLOTTED_LEAF
+    //entries of variable length, the key and value stored by Codec
+    using LeafNode = SlottedLeaf<key_type, value_type>;
+#else
     using LeafNode = BPTNode<key_type, value_type, Leaf>;
+#endif
+    using message_type = Message<key_type, value_type>;
+#ifdef BPT_MESSAGE_BUFFER
+    static_assert(std::is_trivially_copyable_v<message_type>, "BPT_MESSAGE_BUFFER keeps whole keys and values in its pages");
+#endif
 
     KeyHash key_hash{};
     ValueHash value_hash{};
@@ -28,63 +65,1102 @@ namespace RFlowey {
     PagePtr<InnerNode> root_;
     int layer = 0;
 
+#ifdef BPT_LATENCY_STATS
+    LatencyHistogram find_latency_;
+    LatencyHistogram insert_latency_;
+    LatencyHistogram erase_latency_;
+#endif
+
     struct BPT_config {
       bool is_set;
       int layer;
       page_id_t root_id;
+      page_id_t buffer_head;
+      page_id_t aux_page;
+      page_id_t bloom_head;
+      //layout_tag() of the build that saved the file, 0 in files older than the field
+      hash_t layout;
     };
 
+    /**
+     * @brief fingerprint of the key and value types and of the page formats of the leaves and the
+     * inner nodes, as each node type describes its own, never 0. A file saved with another layout
+     * would be misread page by page, so the constructor refuses it.
+     */
+    static hash_t layout_tag() {
+      hash_t tag = 0;
+      auto fold = [&tag](hash_t part) {
+        tag = mix(tag ^ part);
+      };
+      for (const char *name : {typeid(Key).name(), typeid(Value).name()}) {
+        for (; *name != '\0'; ++name) {
+          fold(static_cast<unsigned char>(*name));
+        }
+      }
+      fold(sizeof(Key));
+      fold(sizeof(Value));
+      fold(LeafNode::layout());
+      fold(InnerNode::layout());
+      return tag == 0 ? 1 : tag;
+    }
+
     struct FindResult {
       pair<PageRef<LeafNode>, index_type> cur_pos;
       sjtu::vector<pair<PageRef<InnerNode>, index_type> > parents;
+      //every key of the leaf is below the upper fence; the rightmost leaf has none
+      bool has_upper_fence = false;
+      key_type upper_fence{};
+      //no key of the leaves left of this one is above the lower fence
+      key_type lower_fence{};
     };
 
+  public:
+    //the write a descent is for: its route keeps the nodes an insert may split or an erase may merge
     enum class OperationType { FIND, INSERT, DELETE };
+    //what a conditional write does with the entry it found, see modify_entry and modify_key
+    enum class WriteAction { KEEP, PUT, ERASE };
+
+  private:
+
+    void save_config() {
+#ifdef BPT_BLOOM_FILTER
+      page_id_t bloom_head = bloom_.head();
+#else
+      page_id_t bloom_head = INVALID_PAGE_ID;
+#endif
+      BPT_config cfg_to_save = {true, layer, root_.page_id(), buffer_.head(), aux_page_, bloom_head, layout_tag()};
+      PagePtr<BPT_config>{1, &manager_}.make_ref(std::move(cfg_to_save));
+    }
+
+    //a page owned by a structure built on the tree, saved with the config (see io_manager())
+    page_id_t aux_page_ = INVALID_PAGE_ID;
+
+    //messages not yet applied to the tree, see BPT_MESSAGE_BUFFER
+    MessageBuffer<message_type> buffer_;
+#ifdef BPT_MEMTABLE
+    //writes not yet applied to the tree, kept in memory only and drained by flush() and the destructor
+    MemTable<message_type> memtable_;
+#endif
+#ifdef BPT_BLOOM_FILTER
+    //key hashes of the entries, see BPT_BLOOM_FILTER
+    BloomFilter bloom_;
+#endif
+#ifdef BPT_RESULT_CACHE
+    //values of recently found keys, see BPT_RESULT_CACHE
+    ResultCache<Key, Value> cache_;
+    //the values of a missed key on their way into the cache; swapped with the storage of the evicted entry
+    std::vector<Value> cache_fill_;
+#endif
+#ifdef BPT_TEST
+    //set while find_each calls back, see find_each
+    bool visiting_ = false;
+#endif
+
+    /**
+     * @brief the callback of find_each may not call into the tree, checked in tests
+     */
+    void assert_not_visiting() const {
+#ifdef BPT_TEST
+      assert(!visiting_ && "find_each: f called into the tree");
+#endif
+    }
+
+    Page* root_frame_ = nullptr;
+    uint64_t root_frame_epoch_ = 0;
+
+    //the last leaf an insert appended to; only trusted while it has no next leaf, dropped on merges
+    page_id_t rightmost_leaf_ = INVALID_PAGE_ID;
+    //the key last appended there, filters out the inserts that cannot be appends without reading the leaf
+    key_type rightmost_key_{};
+    //number of inserts in a row that went to the end of the tree
+    int append_streak_ = 0;
+
+    //a node on the route of the last descent and the keys routed to it
+    struct FingerNode {
+      page_id_t page_id = INVALID_PAGE_ID;
+      key_type lower{};
+      bool has_upper = false;
+      key_type upper{};
+
+      [[nodiscard]] bool covers(const key_type &key) const {
+        return !(key < lower) && (!has_upper || key < upper);
+      }
+    };
+    //the route of the last descent, inner nodes from the root down and then the leaf;
+    //trusted while no split, merge, borrow or root change has moved a fence since
+    std::vector<FingerNode> finger_;
+    uint64_t finger_version_ = 0;
+    uint64_t structure_version_ = 1;
+
+    /**
+     * @return the resident page of the root
+     */
+    Page* root_frame() {
+      if (root_frame_epoch_ != manager_.ResidencyEpoch() || root_frame_ == nullptr) {
+        root_frame_ = manager_.Pin(root_.page_id()).get();
+        root_frame_epoch_ = manager_.ResidencyEpoch();
+      }
+      return root_frame_;
+    }
+
+    /**
+     * @brief follow the swizzled pointer of a resident parent to its resident child,
+     * pinning and swizzling the child on first use
+     */
+    Page* child_frame(Page* parent, index_type index, page_id_t child_id) {
+      Page* child = parent->swizzled(index, manager_.ResidencyEpoch());
+      if (child == nullptr || child->page_id() != child_id) {
+        child = manager_.Pin(child_id).get();
+        parent->swizzle(index, child, manager_.ResidencyEpoch());
+      }
+      return child;
+    }
+
+    /**
+     * @brief the depth of every node changes with the layer count, so the resident set is rebuilt lazily
+     */
+    void on_layer_change() {
+      manager_.UnpinAll();
+      ++structure_version_;
+    }
 
     FindResult find_pos(const key_type &key, OperationType type) {
 #ifdef BPT_TEST
       assert(root_.page_id() != INVALID_PAGE_ID && root_.page_id() != 0 && "find_pos called with invalid root");
       assert(layer >= 0 && "find_pos called with invalid layer");
 #endif
+      //start from the route of the last descent: its leaf if it covers key and needs no parents,
+      //or for a lookup the lowest node covering key below the resident layers
+      int start = 0;
+      if (finger_version_ == structure_version_ && finger_.size() == static_cast<size_t>(layer) + 2) {
+        const FingerNode &finger = finger_.back();
+        if (finger.covers(key)) {
+          auto temp = PagePtr<LeafNode>{finger.page_id, &manager_}.get_ref();
+          const LeafNode &leaf = *std::as_const(temp);
+          if (type == OperationType::FIND || (type == OperationType::INSERT && leaf.is_upper_safe()) ||
+            (type == OperationType::DELETE && leaf.is_lower_safe())) {
+            index_type id = leaf.search(key);
+            return {{std::move(temp), id}, {}, finger.has_upper, finger.upper, finger.lower};
+          }
+        } else if (type == OperationType::FIND) {
+          for (int i = layer; i >= PINNED_LAYERS; --i) {
+            if (finger_[i].covers(key)) {
+              start = i;
+              break;
+            }
+          }
+        }
+      }
       sjtu::vector<pair<PageRef<InnerNode>, index_type> > parents;
       page_id_t next = root_.page_id();
       index_type index;
+      key_type lower_fence{};
+      bool has_upper_fence = false;
+      key_type upper_fence{};
+      //the top PINNED_LAYERS are resident and reached through swizzled pointers, no page lookup
+      Page* frame = root_frame();
+      if (start > 0) {
+        const FingerNode &finger = finger_[start];
+        next = finger.page_id;
+        lower_fence = finger.lower;
+        has_upper_fence = finger.has_upper;
+        upper_fence = finger.upper;
+        frame = nullptr;
+      }
+      finger_.resize(start);
+      finger_version_ = structure_version_;
 
-      for (int i = 0; i <= layer; ++i) {
-        PageRef<InnerNode> cur = std::move(PagePtr<InnerNode>{next, &manager_}.get_ref());
+      for (int i = start; i <= layer; ++i) {
+        finger_.push_back({next, lower_fence, has_upper_fence, upper_fence});
+        PageRef<InnerNode> cur;
+        const InnerNode *node;
+        if (frame != nullptr) {
+          node = std::launder(reinterpret_cast<const InnerNode*>(frame->get_data()));
+          if (type != OperationType::FIND) {
+            cur = PageRef<InnerNode>{frame->shared_from_this()};
+          }
+        } else {
+          cur = PagePtr<InnerNode>{next, &manager_}.get_ref();
+          //read through a const view, so that nodes are not marked dirty by a lookup
+          node = &*std::as_const(cur);
+        }
 #ifdef BPT_TEST
-        assert(cur->current_size_ > 0 && "Inner node on path is empty");
+        assert(node->current_size_ > 0 && "Inner node on path is empty");
 #endif
-        index = cur->search(key);
+        index = node->search(key);
         if(index==INVALID_PAGE_ID) {
           index=0;
         }
 #ifdef BPT_TEST
-        assert(index < cur->current_size_ && \
+        assert(index < node->current_size_ && \
                "Search index out of bounds in inner node after valid return.");
 #endif
-        next = cur->at(index).second;
+        next = node->at(index).second;
+        //a deeper separator is always the tighter upper fence; the first separator of a node
+        //may be below the one above it
+        if (lower_fence < key_type(node->at(index).first)) {
+          lower_fence = node->at(index).first;
+        }
+        if (index + 1 < node->current_size_) {
+          has_upper_fence = true;
+          upper_fence = node->at(index + 1).first;
+        }
+        if (frame != nullptr && i < layer && i + 1 < PINNED_LAYERS) {
+          frame = child_frame(frame, index, next);
+        } else {
+          frame = nullptr;
+        }
         if(type!=OperationType::FIND) {
-          if ((type == OperationType::INSERT && cur->is_upper_safe()) ||
-            (type == OperationType::DELETE && cur->is_lower_safe())) {
+          if ((type == OperationType::INSERT && node->is_upper_safe()) ||
+            (type == OperationType::DELETE && node->is_lower_safe())) {
             parents.clear();
             }
           parents.emplace_back(std::move(cur), index);
         }
       }
-      auto temp = PagePtr<LeafNode>{next, &manager_}.get_ref();
-      if ((type == OperationType::INSERT && temp->is_upper_safe()) ||
-        (type == OperationType::DELETE && temp->is_lower_safe())) {
-        parents.clear();
+      finger_.push_back({next, lower_fence, has_upper_fence, upper_fence});
+      auto temp = PagePtr<LeafNode>{next, &manager_}.get_ref();
+      const LeafNode &leaf = *std::as_const(temp);
+      if ((type == OperationType::INSERT && leaf.is_upper_safe()) ||
+        (type == OperationType::DELETE && leaf.is_lower_safe())) {
+        parents.clear();
+      }
+
+      index_type id = leaf.search(key);
+
+      return {{std::move(temp), id}, std::move(parents), has_upper_fence, upper_fence, lower_fence};
+    }
+
+    /**
+     * @brief insert after the position found by find_pos(key, INSERT), splitting along the route
+     */
+    void insert_entry(FindResult &&result, const key_type &key, const value_type &entry) {
+      auto &pos = result.cur_pos;
+      auto &parents = result.parents;
+      const LeafNode &leaf = *std::as_const(pos.first);
+      bool appending = leaf.next_node_id_ == INVALID_PAGE_ID && pos.second + 1 == leaf.current_size_;
+      append_streak_ = appending ? append_streak_ + 1 : 0;
+      pos.first->insert_at(pos.second, {key, entry});
+      if (parents.empty()) {
+        if (appending) {
+          rightmost_leaf_ = leaf.self_id_;
+          rightmost_key_ = key;
+        }
+        return;
+      }
+      ++structure_version_;
+      //split on the route. While appending, the full nodes on the right edge keep everything
+      //but the new entry, so that a time-ordered ingest leaves full pages behind
+      bool tail_split = appending && append_streak_ >= APPEND_STREAK;
+      auto leaf_ptr = allocate<LeafNode>(&manager_);
+      auto page_ref = tail_split ? pos.first->split(leaf_ptr, leaf.current_size_ - 1) : pos.first->split(leaf_ptr);
+      auto page_id = page_ref->self_id_;
+      auto first_key = page_ref->get_first();
+      if (page_ref->next_node_id_ == INVALID_PAGE_ID) {
+        rightmost_leaf_ = page_id;
+        rightmost_key_ = page_ref->key_at(page_ref->current_size_ - 1);
+      }
+      while (!parents.empty()) {
+        auto parent_node = std::move(parents.back().first);
+        auto index = std::move(parents.back().second);
+        parents.pop_back();
+        parent_node->insert_at(index, {first_key, child(page_id)});
+        if (parent_node->current_size_>=InnerNode::SPLIT_T) {
+          auto inner_ptr = allocate<InnerNode>(&manager_);
+          auto inner_ref = tail_split ? parent_node->split(inner_ptr, parent_node->current_size_ - 1) : parent_node->split(inner_ptr);
+          page_id = inner_ref->self_id_;
+          first_key = inner_ref->get_first();
+        } else {
+#ifdef BPT_TEST
+          assert(parents.empty());
+#endif
+          //最上面的不应该需要Split,除非是根节点
+          return;
+        }
+      }
+      //root分裂了，增加新root
+      auto new_ptr = allocate<InnerNode>(&manager_);
+      InnerNode::value_type temp_data[2] = {{{0,0}, child(root_.page_id())}, {first_key, child(page_id)}};
+      auto new_root = new_ptr.make_ref(InnerNode{new_ptr.page_id(), 2, temp_data});
+      root_ = new_ptr;
+      ++layer;
+      on_layer_change();
+    }
+
+    /**
+     * @brief insert at the end of the cached rightmost leaf without a descent
+     * @return false if the key does not belong past the last entry of the tree or the leaf is full
+     */
+    bool try_append(const key_type &key, const value_type &entry) {
+      if (rightmost_leaf_ == INVALID_PAGE_ID || !(rightmost_key_ < key)) {
+        return false;
+      }
+      auto leaf = PagePtr<LeafNode>{rightmost_leaf_, &manager_}.get_ref();
+      const LeafNode &node = *std::as_const(leaf);
+      //every separator on the route to the rightmost leaf is at most its first key,
+      //so a key above its last entry is routed here
+      if (node.next_node_id_ != INVALID_PAGE_ID || node.current_size_ == 0 ||
+          !(node.key_at(node.current_size_ - 1) < key) || !node.is_upper_safe()) {
+        return false;
+      }
+      leaf->insert_at(node.current_size_ - 1, {key, entry});
+      rightmost_key_ = key;
+      ++append_streak_;
+      return true;
+    }
+
+    /**
+     * @brief rebalance an underfull node with its siblings under the same parent:
+     * merge with the left or the right one if the two fit into one node, otherwise move entries
+     * over from the fuller sibling and move the separator between them in the parent
+     * @return true if a merge removed an entry from the parent
+     */
+    template<typename Node>
+    bool rebalance(PageRef<Node> &node, PageRef<InnerNode> &parent, index_type index) {
+      const InnerNode &parent_view = *std::as_const(parent);
+      page_id_t left_id = index > 0 ? parent_view.data_[index - 1].second : INVALID_PAGE_ID;
+      page_id_t right_id = index + 1 < parent_view.current_size_ ? parent_view.data_[index + 1].second : INVALID_PAGE_ID;
+      if (left_id == INVALID_PAGE_ID && right_id == INVALID_PAGE_ID) {
+        return false;
+      }
+      ++structure_version_;
+      size_t left_size = 0, right_size = 0;
+      if (left_id != INVALID_PAGE_ID) {
+        auto left = PagePtr<Node>{left_id, &manager_}.get_ref();
+        if (left->absorb(*node, &manager_)) {
+          parent->erase(index);
+          return true;
+        }
+        left_size = std::as_const(left)->load();
+      }
+      if (right_id != INVALID_PAGE_ID) {
+        auto right = PagePtr<Node>{right_id, &manager_}.get_ref();
+        if (node->absorb(*right, &manager_)) {
+          parent->erase(index + 1);
+          return true;
+        }
+        right_size = std::as_const(right)->load();
+      }
+      //neither fits, so the fuller sibling has entries to spare
+      if (left_size >= right_size) {
+        auto left = PagePtr<Node>{left_id, &manager_}.get_ref();
+        node->borrow_from_left(*left);
+        parent->head(index) = node->get_first();
+      } else {
+        auto right = PagePtr<Node>{right_id, &manager_}.get_ref();
+        node->borrow_from_right(*right);
+        parent->head(index + 1) = right->get_first();
+      }
+      return false;
+    }
+
+    /**
+     * @brief erase the entry found by find_pos(key, DELETE), rebalancing along the route
+     * @return false if there is no entry with exactly this key
+     */
+    bool erase_entry(FindResult &&result, const key_type &key) {
+      auto &pos = result.cur_pos;
+      const LeafNode &leaf = *std::as_const(pos.first);
+      if(pos.second>=leaf.current_size_||leaf.key_at(pos.second)!=key) {
+        if (result.lower_fence < key) {
+          return false;
+        }
+        //copies of key may sit in the leaves to the left, release the route before walking them
+        { auto released = std::move(result); }
+        return erase_spanned(key);
+      }
+      pos.first->erase(pos.second);
+      if(!leaf.is_underfull()) {
+        return true;
+      }
+#ifdef BPT_LAZY_REBALANCE
+      pending_rebalance_.push_back(key);
+      if (pending_rebalance_.size() >= REBALANCE_BATCH) {
+        //release the leaf first, so that the rebalance reads the erased version back
+        { auto written = std::move(pos.first); }
+        result.parents.clear();
+        rebalance_pending();
+      }
+#else
+      rebalance_path(std::move(result));
+#endif
+      return true;
+    }
+
+    /**
+     * @brief erase the last entry on exactly key, walking the leaves from the one predecessor(key)
+     * routes to. Copies of a key may span leaves, and once the copies right of a separator equal to
+     * key are erased the leaf it routes to holds none of the ones left of it.
+     * @return false if there is no entry with exactly this key
+     */
+    bool erase_spanned(const key_type &key) {
+      page_id_t found = INVALID_PAGE_ID;
+      {
+        auto leaf = find_pos(predecessor(key), OperationType::FIND).cur_pos.first;
+        while (true) {
+          const LeafNode &node = *std::as_const(leaf);
+          index_type index = node.search(key);
+          if (index < node.current_size_ && node.key_at(index) == key) {
+            found = node.self_id_;
+          }
+          if ((node.current_size_ > 0 && key < node.key_at(node.current_size_ - 1)) ||
+              node.next_node_id_ == INVALID_PAGE_ID) {
+            break;
+          }
+          leaf = PagePtr<LeafNode>{node.next_node_id_, &manager_}.get_ref();
+        }
+      }
+      if (found == INVALID_PAGE_ID) {
+        return false;
+      }
+      std::vector<key_type> underfull;
+      {
+        auto leaf = PagePtr<LeafNode>{found, &manager_}.get_ref();
+        const LeafNode &node = *std::as_const(leaf);
+        key_type first = node.key_at(0);
+        leaf->erase(node.search(key));
+        if (node.is_underfull()) {
+          underfull.push_back(first);
+        }
+      }
+#ifdef BPT_LAZY_REBALANCE
+      pending_rebalance_.insert(pending_rebalance_.end(), underfull.begin(), underfull.end());
+#else
+      rebalance_leaves(underfull);
+#endif
+      return true;
+    }
+
+    /**
+     * @brief rebalance the underfull leaf found by find_pos(key, DELETE) and, after merges,
+     * its ancestors; shrink the root if it is left with one child
+     */
+    void rebalance_path(FindResult &&result) {
+      auto &pos = result.cur_pos;
+      auto &parents = result.parents;
+      if(parents.empty()||!rebalance(pos.first, parents.back().first, parents.back().second)) {
+        return;
+      }
+      rightmost_leaf_ = INVALID_PAGE_ID;
+      //a merge took an entry from the parent, which may be underfull in turn
+      while (parents.size() > 1) {
+        auto node = std::move(parents.back().first);
+        parents.pop_back();
+        if (std::as_const(node)->current_size_>InnerNode::MERGE_T ||
+            !rebalance(node, parents.back().first, parents.back().second)) {
+          break;
+        }
+      }
+      parents.clear();
+      const auto root = root_.get_ref();
+      if(root->current_size_==1&&layer>0) {
+        root_ = PagePtr<InnerNode>{root->data_[0].second,&manager_};
+        --layer;
+        manager_.DeletePage(root->get_self());
+        on_layer_change();
+      }
+    }
+
+    /**
+     * @brief rebalance the leaves of keys that were left underfull, in key order. A leaf may have been
+     * refilled or merged since, so each key is looked up again.
+     */
+    void rebalance_leaves(std::vector<key_type> &keys) {
+      std::sort(keys.begin(), keys.end());
+      keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+      for (const auto &key : keys) {
+        auto result = find_pos(key, OperationType::DELETE);
+        if (std::as_const(result.cur_pos.first)->is_underfull()) {
+          rebalance_path(std::move(result));
+        }
+      }
+    }
+
+#ifdef BPT_LAZY_REBALANCE
+    //keys of leaves erase left underfull
+    std::vector<key_type> pending_rebalance_;
+
+    /**
+     * @brief rebalance the leaves queued by erase
+     */
+    void rebalance_pending() {
+      std::vector<key_type> keys;
+      keys.swap(pending_rebalance_);
+      rebalance_leaves(keys);
+    }
+#endif
+
+    /**
+     * @brief erase every entry with lower <= key < upper, see erase_span
+     */
+    size_t erase_hashes(const key_type &lower, const key_type &upper) {
+      size_t erased = erase_span(lower, upper, [](const typename LeafNode::value_type &) {
+        return true;
+      });
+#ifdef BPT_BLOOM_FILTER
+      bloom_.note_erase(erased);
+#endif
+      return erased;
+    }
+
+    /**
+     * @brief erase the entries with lower <= key < upper for which pred(entry) holds, walking the
+     * leaves once along next_node_id_; the leaves left underfull are rebalanced at the end.
+     * An upper that is not above lower leaves the range open.
+     * @return the number of entries erased
+     */
+    template<typename Pred>
+    size_t erase_span(const key_type &lower, const key_type &upper, Pred &&pred) {
+      assert_not_visiting();
+#ifdef BPT_MEMTABLE
+      drain(memtable_);
+#endif
+      drain(buffer_);
+      bool bounded = lower < upper;
+      size_t erased = 0;
+      std::vector<key_type> underfull;
+      auto leaf = find_pos(predecessor(lower), OperationType::FIND).cur_pos.first;
+      while (true) {
+        const LeafNode &node = *std::as_const(leaf);
+        //the first key routes to the leaf even once it is erased
+        key_type first = node.current_size_ > 0 ? node.key_at(0) : lower;
+        bool past_end = bounded && node.current_size_ > 0 && node.key_at(node.current_size_ - 1) >= upper;
+        auto erase = [&](const typename LeafNode::value_type &entry) {
+          //the first entry of the tree is a sentinel
+          return !(bounded && entry.first >= upper) && entry.first >= lower && !(entry.first == key_type{0,0}) &&
+                 pred(entry);
+        };
+        //the leaf is only written if it has something to erase
+        size_t i = 0;
+        while (i < node.current_size_ && !erase(node.at(i))) {
+          ++i;
+        }
+        if (i < node.current_size_) {
+          erased += leaf->erase_if(erase);
+          if (node.is_underfull()) {
+            underfull.push_back(first);
+          }
+        }
+        if (past_end || node.next_node_id_ == INVALID_PAGE_ID) {
+          break;
+        }
+        leaf = PagePtr<LeafNode>{node.next_node_id_, &manager_}.get_ref();
+      }
+      { auto written = std::move(leaf); }
+      rebalance_leaves(underfull);
+      return erased;
+    }
+
+    /**
+     * @brief apply messages sorted by key, messages on one key in arrival order.
+     * Messages falling into one leaf share a single descent and leaf write as long as the leaf
+     * stays safe; a message that needs a split or a merge takes the single-entry path.
+     */
+    void apply_sorted(const message_type *messages, size_t count) {
+      size_t i = 0;
+      while (i < count) {
+        const message_type &first = messages[i];
+        if (first.op == MessageOp::NONE) {
+          ++i;
+          continue;
+        }
+        auto result = find_pos(first.key, first.op == MessageOp::INSERT ? OperationType::INSERT : OperationType::DELETE);
+        auto &leaf = result.cur_pos.first;
+        size_t applied = 0;
+        for (; i < count && (!result.has_upper_fence || messages[i].key < result.upper_fence); ++i, ++applied) {
+          const message_type &message = messages[i];
+          const LeafNode &node = *std::as_const(leaf);
+          if (message.op == MessageOp::INSERT) {
+            if (!node.is_upper_safe()) {
+              break;
+            }
+            leaf->insert_at(node.search(message.key), {message.key, message.value});
+          } else if (message.op == MessageOp::ERASE) {
+            index_type index = node.search(message.key);
+            //a miss may have copies in the leaves to the left, which erase_entry walks
+            if (index >= node.current_size_ || node.key_at(index) != message.key || !node.is_lower_safe()) {
+              break;
+            }
+            leaf->erase(index);
+          }
+        }
+        if (applied == 0) {
+          //result was computed for the operation of the first message
+          if (first.op == MessageOp::INSERT) {
+            insert_entry(std::move(result), first.key, first.value);
+          } else {
+            erase_entry(std::move(result), first.key);
+          }
+          ++i;
+        }
+      }
+    }
+
+    /**
+     * @brief push every message of a MessageBuffer or MemTable down into the tree
+     */
+    template<typename Buffer>
+    void drain(Buffer &buffer) {
+      if (buffer.empty()) {
+        return;
+      }
+      auto messages = buffer.sorted();
+      apply_sorted(messages.data(), messages.size());
+      buffer.clear();
+    }
+
+    template<typename Buffer>
+    void push_message(Buffer &buffer, const message_type &message) {
+#ifdef BPT_SLOTTED_LEAF
+      //refused here rather than when the buffer is drained
+      if (message.op == MessageOp::INSERT) {
+        LeafNode::footprint(message.value);
+      }
+#endif
+      buffer.push(message);
+      if (buffer.full()) {
+        drain(buffer);
+      }
+    }
+
+    /**
+     * @brief erase through a buffer. The live messages of one key are some erases followed by
+     * some inserts: an erase cancels the newest pending insert, or is buffered if the tree
+     * still holds a copy, so the result is the same as erasing from the tree directly.
+     */
+    template<typename Buffer>
+    bool erase_message(Buffer &buffer, const key_type &key, const value_type &entry) {
+      auto [begin, end] = buffer.equal_range(key);
+      if (begin != end && buffer[std::prev(end)].op == MessageOp::INSERT) {
+        buffer.cancel(std::prev(end));
+        return true;
+      }
+      size_t pending_erases = std::distance(begin, end);
+      size_t copies = 0;
+      scan_tree(key, successor(key), [&](const typename LeafNode::value_type &) {
+        ++copies;
+        return true;
+      });
+      if (copies <= pending_erases) {
+        return false;
+      }
+      push_message(buffer, {key, entry, MessageOp::ERASE});
+      return true;
+    }
+
+    /**
+     * @return the smallest key above key; past the largest key it wraps to {0,0}, which ranges read as open
+     */
+    static key_type successor(const key_type &key) {
+      if (key.second != std::numeric_limits<hash_t>::max()) {
+        return {key.first, key.second + 1};
+      }
+      return {key.first + 1, 0};
+    }
+
+    /**
+     * @return the largest key below key, {0,0} for {0,0}
+     */
+    static key_type predecessor(const key_type &key) {
+      if (key.second != 0) {
+        return {key.first, key.second - 1};
+      }
+      if (key.first != 0) {
+        return {key.first - 1, std::numeric_limits<hash_t>::max()};
+      }
+      return key;
+    }
+
+    [[nodiscard]] bool has_pending(const key_type &lower, const key_type &upper) const {
+      auto [begin, end] = buffer_.range(lower, upper);
+#ifdef BPT_MEMTABLE
+      auto [mem_begin, mem_end] = memtable_.range(lower, upper);
+      return begin != end || mem_begin != mem_end;
+#else
+      return begin != end;
+#endif
+    }
+
+    /**
+     * @brief apply the pending messages on key to entries, which are sorted by key_type
+     */
+    template<typename Buffer>
+    void replay(const Buffer &buffer, const Key &key, const key_type &lower, const key_type &upper,
+                std::vector<typename LeafNode::value_type> &entries) const {
+      auto [begin, end] = buffer.range(lower, upper);
+      for (auto it = begin; it != end; ++it) {
+        const message_type &message = buffer[it];
+        auto pos = std::upper_bound(entries.begin(), entries.end(), message.key,
+          [](const key_type &k, const typename LeafNode::value_type &e) { return k < e.first; });
+        if (message.op == MessageOp::INSERT) {
+          if (message.value.first == key) {
+            entries.insert(pos, typename LeafNode::value_type{message.key, message.value});
+          }
+        } else if (pos != entries.begin() && (pos - 1)->first == message.key) {
+          entries.erase(pos - 1);
+        }
+      }
+    }
+
+    /**
+     * @brief call f(entry) for every leaf entry with lower <= key < upper, in key order, until f returns false;
+     * an upper that is not above lower leaves the range open
+     */
+    template<typename F>
+    void scan_tree(const key_type &lower, const key_type &upper, F &&f) {
+      bool bounded = lower < upper;
+      //start just below lower: the search lands on the last of equal keys, which may span several leaves
+      auto result = find_pos(predecessor(lower), OperationType::FIND);
+      auto leaf = std::move(result.cur_pos.first);
+      auto index = result.cur_pos.second;
+      if(index==INVALID_PAGE_ID) {
+        index=0;
+      }
+      while (true) {
+        const LeafNode &node = *std::as_const(leaf);
+        if (index >= node.current_size_) {
+          if(node.next_node_id_ != INVALID_PAGE_ID) {
+            index = 0;
+            leaf = PagePtr<LeafNode>{node.next_node_id_, &manager_}.get_ref();
+            continue;
+          } else {
+            break;
+          }
+        }
+        //entries are visited in place, a leaf entry is about a hundred bytes
+        const key_type &entry_key = node.key_at(index);
+        if (bounded && entry_key >= upper) {
+          break;
+        }
+        if (entry_key >= lower && !f(node.at(index))) {
+          break;
+        }
+        ++index;
+      }
+    }
+
+    /**
+     * @brief call f(value) for every value of key whose tree key is in [lower, upper), sorted by
+     * the hash of value, until f returns false
+     */
+    template<typename F>
+    void visit_values(const Key &key, const key_type &lower, const key_type &upper, F &&f) {
+      if (!has_pending(lower, upper)) {
+        scan_tree(lower, upper, [&](const typename LeafNode::value_type &entry) {
+          return !(entry.second.first == key) || f(entry.second.second);
+        });
+        return;
+      }
+      //replay the pending messages of this key on top of the tree entries, oldest first
+      std::vector<typename LeafNode::value_type> entries;
+      scan_tree(lower, upper, [&](const typename LeafNode::value_type &entry) {
+        if (entry.second.first == key) {
+          entries.push_back(entry);
+        }
+        return true;
+      });
+      replay(buffer_, key, lower, upper, entries);
+#ifdef BPT_MEMTABLE
+      replay(memtable_, key, lower, upper, entries);
+#endif
+      for (const auto &entry : entries) {
+        if (!f(entry.second.second)) {
+          return;
+        }
+      }
+    }
+
+    /**
+     * @brief call f(value) for the values of key, like visit_values, consulting the filter
+     * and the cache first; a cache miss is only filled if f never stops early
+     */
+    template<typename F>
+    void visit_key(const Key &key, hash_t hash, F &&f) {
+#ifdef BPT_BLOOM_FILTER
+      if (!bloom_.may_contain(hash)) {
+        return;
+      }
+#endif
+#ifdef BPT_RESULT_CACHE
+      if (const std::vector<Value> *cached = cache_.find(hash, key)) {
+        for (const Value &value : *cached) {
+          if (!f(value)) {
+            return;
+          }
+        }
+        return;
+      }
+#endif
+      visit_values(key, {hash,0}, {hash+1,0}, f);
+    }
+
+#if defined(BPT_MEMTABLE) || defined(BPT_MESSAGE_BUFFER)
+    /**
+     * @return the entry on exactly key, with the pending messages applied
+     */
+    std::optional<value_type> current_entry(const key_type &key) {
+      std::optional<value_type> current;
+      scan_tree(key, successor(key), [&current](const typename LeafNode::value_type &entry) {
+        current = entry.second;
+        return false;
+      });
+      auto apply = [&](const auto &buffer) {
+        auto [begin, end] = buffer.equal_range(key);
+        if (begin != end) {
+          const message_type &message = buffer[std::prev(end)];
+          current = message.op == MessageOp::INSERT ? std::optional<value_type>(message.value) : std::nullopt;
+        }
+      };
+      apply(buffer_);
+#ifdef BPT_MEMTABLE
+      apply(memtable_);
+#endif
+      return current;
+    }
+#endif
+
+    /**
+     * @brief look up the entry on exactly key and apply decide(current) to it, current being
+     * nullptr if there is none: PUT stores entry in its place or inserts it, ERASE removes it.
+     * The plain tree decides and writes in one descent of the given type.
+     * @return the action taken
+     */
+    template<typename Decide>
+    WriteAction modify_entry(const key_type &key, const value_type &entry, OperationType type, Decide &&decide) {
+      assert_not_visiting();
+#ifdef BPT_RESULT_CACHE
+      cache_.invalidate(key.first);
+#endif
+#ifdef BPT_BLOOM_FILTER
+      //rebuilt before the descent, the rebuild reads the leaves the descent would hold
+      if (bloom_.full()) {
+        rebuild_bloom(bloom_.count());
+      }
+#endif
+#if defined(BPT_MEMTABLE) || defined(BPT_MESSAGE_BUFFER)
+#ifdef BPT_MEMTABLE
+      auto &buffer = memtable_;
+#else
+      auto &buffer = buffer_;
+#endif
+      std::optional<value_type> current = current_entry(key);
+      bool present = current.has_value();
+      WriteAction action = decide(present ? &*current : nullptr);
+      if (action == WriteAction::KEEP || (action == WriteAction::ERASE && !present)) {
+        return WriteAction::KEEP;
+      }
+      if (present) {
+        erase_message(buffer, key, *current);
+      }
+      if (action == WriteAction::PUT) {
+        push_message(buffer, {key, entry, MessageOp::INSERT});
+      }
+#else
+      auto result = find_pos(key, type);
+      const LeafNode &leaf = *std::as_const(result.cur_pos.first);
+      index_type index = result.cur_pos.second;
+      bool present = index < leaf.current_size_ && leaf.key_at(index) == key;
+      auto decide_on = [&decide](const typename LeafNode::value_type &current) {
+        return decide(&current.second);
+      };
+      WriteAction action = present ? decide_on(leaf.at(index)) : decide(nullptr);
+      if (action == WriteAction::KEEP || (action == WriteAction::ERASE && !present)) {
+        return WriteAction::KEEP;
+      }
+      if (action == WriteAction::ERASE) {
+        erase_entry(std::move(result), key);
+      } else if (!present) {
+        insert_entry(std::move(result), key, entry);
+      } else if (!result.cur_pos.first->replace(index, entry)) {
+        //a longer record that would crowd its leaf is erased and inserted again, splitting the leaf
+        { auto released = std::move(result); }
+        erase_entry(find_pos(key, OperationType::DELETE), key);
+        insert_entry(find_pos(key, OperationType::INSERT), key, entry);
+      }
+#endif
+#ifdef BPT_BLOOM_FILTER
+      if (action == WriteAction::ERASE) {
+        bloom_.note_erase();
+      } else if (!present) {
+        bloom_.add(key.first);
+      }
+#endif
+      return action;
+    }
+
+#ifdef BPT_BLOOM_FILTER
+    /**
+     * @brief refill the filter with the key hash of every entry, pending inserts included,
+     * sized for twice the expected number of entries (grown again if there turn out to be more)
+     */
+    void rebuild_bloom(size_t expected) {
+      do {
+        bloom_.reset(2 * expected);
+        auto leaf = find_pos({0,0}, OperationType::FIND).cur_pos.first;
+        while (true) {
+          const LeafNode &node = *std::as_const(leaf);
+          for (size_t i = 0; i < node.current_size_; ++i) {
+            bloom_.add(node.key_at(i).first);
+          }
+          if (node.next_node_id_ == INVALID_PAGE_ID) {
+            break;
+          }
+          leaf = PagePtr<LeafNode>{node.next_node_id_, &manager_}.get_ref();
+        }
+        auto add_pending = [this](const auto &buffer) {
+          for (const message_type &message : buffer.sorted()) {
+            if (message.op == MessageOp::INSERT) {
+              bloom_.add(message.key.first);
+            }
+          }
+        };
+        add_pending(buffer_);
+#ifdef BPT_MEMTABLE
+        add_pending(memtable_);
+#endif
+        expected = bloom_.count();
+      } while (bloom_.full());
+    }
+#endif
+
+    /**
+     * @brief write the filter back, rebuilt first if most of its hashes may have been erased
+     */
+    void save_bloom() {
+#ifdef BPT_BLOOM_FILTER
+      if (bloom_.stale()) {
+        rebuild_bloom(bloom_.live());
+      }
+      bloom_.save();
+#endif
+    }
+
+    /**
+     * @brief split [0, count) into at most threads runs and call f(begin, end) on each, one thread
+     * per run; the calling thread takes the last run
+     */
+    template<typename F>
+    static void parallel_runs(size_t count, size_t threads, F &&f) {
+      threads = std::max<size_t>(1, std::min(threads, count));
+      std::vector<std::thread> workers;
+      for (size_t t = 0; t + 1 < threads; ++t) {
+        workers.emplace_back([&f, begin = count * t / threads, end = count * (t + 1) / threads] {
+          f(begin, end);
+        });
+      }
+      f(count * (threads - 1) / threads, count);
+      for (auto &worker : workers) {
+        worker.join();
+      }
+    }
+
+    /**
+     * @brief sort the runs of order on threads, then merge neighbouring runs pairwise, the pairs in
+     * parallel, until one run is left. The index breaks ties, so equal keys keep their input order.
+     */
+    static void parallel_sort(std::vector<std::pair<key_type, size_t>> &order, size_t threads) {
+      auto less = [](const std::pair<key_type, size_t> &lhs, const std::pair<key_type, size_t> &rhs) {
+        return lhs.first < rhs.first || (lhs.first == rhs.first && lhs.second < rhs.second);
+      };
+      threads = std::max<size_t>(1, std::min(threads, order.size()));
+      std::vector<size_t> bounds;
+      for (size_t t = 0; t <= threads; ++t) {
+        bounds.push_back(order.size() * t / threads);
+      }
+      parallel_runs(order.size(), threads, [&](size_t begin, size_t end) {
+        std::sort(order.begin() + begin, order.begin() + end, less);
+      });
+      while (bounds.size() > 2) {
+        size_t merges = (bounds.size() - 1) / 2;
+        parallel_runs(merges, merges, [&](size_t begin, size_t end) {
+          for (size_t m = begin; m < end; ++m) {
+            std::inplace_merge(order.begin() + bounds[2 * m], order.begin() + bounds[2 * m + 1],
+                               order.begin() + bounds[2 * m + 2], less);
+          }
+        });
+        std::vector<size_t> merged;
+        for (size_t i = 0; i < bounds.size(); i += 2) {
+          merged.push_back(bounds[i]);
+        }
+        if (merged.back() != bounds.back()) {
+          merged.push_back(bounds.back());
+        }
+        bounds.swap(merged);
+      }
+    }
+
+    /**
+     * @return the bounds of a level of size entries in nodes of at most per entries, as many as
+     * needed and sharing the entries evenly: node i holds the entries bounds[i] <= j < bounds[i+1]
+     */
+    static std::vector<size_t> even_bounds(size_t size, size_t per) {
+      std::vector<size_t> bounds(std::max<size_t>(1, (size + per - 1) / per) + 1);
+      for (size_t i = 0; i < bounds.size(); ++i) {
+        bounds[i] = size * i / (bounds.size() - 1);
+      }
+      return bounds;
+    }
+
+    /**
+     * @return the bounds of the leaves over the entries entry(j), j < size, like even_bounds
+     */
+    template<typename Entry>
+    static std::vector<size_t> leaf_bounds(size_t size, Entry &&entry) {
+#ifdef BPT_SLOTTED_LEAF
+      //leaves of at most FILL_T bytes, each cut where the bytes before it reach its share
+      std::vector<size_t> before(size + 1);
+      for (size_t j = 0; j < size; ++j) {
+        before[j + 1] = before[j] + LeafNode::footprint(entry(j).second);
+      }
+      std::vector<size_t> bounds(std::max<size_t>(1, (before[size] + LeafNode::FILL_T - 1) / LeafNode::FILL_T) + 1);
+      for (size_t i = 0; i < bounds.size(); ++i) {
+        size_t share = before[size] * i / (bounds.size() - 1);
+        bounds[i] = std::lower_bound(before.begin(), before.end(), share) - before.begin();
       }
+      return bounds;
+#else
+      (void)entry;
+      return even_bounds(size, LeafNode::SPLIT_T - 1);
+#endif
+    }
 
-      index_type id = temp->search(key);
+    /**
+     * @return count page ids, taken one after the other, so that a level is a single extent of the file
+     */
+    std::vector<page_id_t> reserve_level(size_t count) {
+      std::vector<page_id_t> ids(count);
+      for (auto &id : ids) {
+        id = manager_.NewPage();
+      }
+      return ids;
+    }
 
-      return {{std::move(temp), id}, std::move(parents)};
+    /**
+     * @brief write the nodes of a level on threads: node i goes to ids[i], holds the entries
+     * entry(j) for bounds[i] <= j < bounds[i+1], and is linked to its neighbours on the level.
+     * The ids are known beforehand, so the runs of the threads are stitched as they are written.
+     */
+    template<typename Node, typename Entry>
+    void write_level(const std::vector<page_id_t> &ids, const std::vector<size_t> &bounds, size_t threads,
+                     Entry &&entry) {
+      size_t n = ids.size();
+      parallel_runs(n, threads, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+          auto node = std::make_unique<Node>(ids[i]);
+          node->prev_node_id_ = i > 0 ? ids[i - 1] : INVALID_PAGE_ID;
+          node->next_node_id_ = i + 1 < n ? ids[i + 1] : INVALID_PAGE_ID;
+          for (size_t j = bounds[i]; j < bounds[i + 1]; ++j) {
+            node->push_back(entry(j));
+          }
+          PagePtr<Node>{ids[i], &manager_}.make_ref(std::move(node));
+        }
+      });
     }
 
   public:
     explicit BPT(const std::string &file_name): manager_(file_name),root_(INVALID_PAGE_ID,nullptr) {//root not right now
+    page_id_t buffer_head = INVALID_PAGE_ID;
+    page_id_t bloom_head = INVALID_PAGE_ID;
     if(manager_.is_new) {
 #ifdef BPT_TEST
       std::cerr << "Initializing new BPT database..." << std::endl;
@@ -108,7 +1184,7 @@ namespace RFlowey {
       assert(temp_leaf_ref->self_id_ == first_leaf_ptr.page_id());
 #endif
 
-      InnerNode::value_type initial_root_data[1] = { {{0,0}, first_leaf_ptr.page_id()} };
+      InnerNode::value_type initial_root_data[1] = { {{0,0}, child(first_leaf_ptr.page_id())} };
       auto temp_root_ref = new_root_ptr.make_ref(InnerNode{new_root_ptr.page_id(), 1, initial_root_data});
 #ifdef BPT_TEST
       assert(temp_root_ref->current_size_ == 1);
@@ -120,6 +1196,10 @@ namespace RFlowey {
 
       PagePtr<BPT_config> cfg_ptr{1, &manager_};
       auto cfg_ref = cfg_ptr.get_ref();
+      //files older than the tag are taken as they are and tagged when saved
+      if (cfg_ref->layout != 0 && cfg_ref->layout != layout_tag()) {
+        throw std::runtime_error("BPT: " + file_name + " was saved with another key, value or node layout");
+      }
 #ifdef BPT_TEST
       assert(cfg_ref->layer >= 0 && "Loaded layer should be non-negative");
       assert(cfg_ref->root_id != INVALID_PAGE_ID && "Loaded root_id should be valid");
@@ -128,6 +1208,16 @@ namespace RFlowey {
 #endif
       this->root_ = PagePtr<InnerNode>{cfg_ref->root_id, &manager_};
       this->layer = cfg_ref->layer;
+      //files written before these fields existed hold 0 here
+      if (cfg_ref->buffer_head != 0) {
+        buffer_head = cfg_ref->buffer_head;
+      }
+      if (cfg_ref->aux_page != 0) {
+        aux_page_ = cfg_ref->aux_page;
+      }
+      if (cfg_ref->bloom_head != 0) {
+        bloom_head = cfg_ref->bloom_head;
+      }
 #ifdef BPT_TEST
       assert(this->layer >= 0);
       assert(this->root_.page_id() != INVALID_PAGE_ID && this->root_.page_id() != 0);
@@ -136,6 +1226,22 @@ namespace RFlowey {
       assert(root_check_ref->self_id_ == this->root_.page_id());
 #endif
     }
+    //a buffer has pages only if its messages can be stored in them, see BPT_SLOTTED_LEAF
+    if constexpr (std::is_trivially_copyable_v<message_type>) {
+      buffer_.open(&manager_, buffer_head);
+    }
+#ifndef BPT_MESSAGE_BUFFER
+    //left behind by a buffered build
+    drain(buffer_);
+#endif
+#ifdef BPT_BLOOM_FILTER
+    //a file saved without the filter, or by a build without it, may be out of step with it
+    if (!bloom_.open(&manager_, bloom_head)) {
+      rebuild_bloom(0);
+    }
+#else
+    (void)bloom_head;
+#endif
 
 
   }
@@ -149,8 +1255,14 @@ namespace RFlowey {
       }
 #endif
       if (root_.page_id() != INVALID_PAGE_ID && root_.page_id() != 0) { // Only save if root seems valid
-        BPT_config cfg_to_save = {true, layer, root_.page_id()};
-        PagePtr<BPT_config>{1, &manager_}.make_ref(std::move(cfg_to_save)); // Use std::move for unique_ptr if make_ref takes it
+#ifdef BPT_MEMTABLE
+        drain(memtable_);
+#endif
+#ifdef BPT_LAZY_REBALANCE
+        rebalance_pending();
+#endif
+        save_bloom();
+        save_config();
       } else {
 #ifdef BPT_TEST
         std::cerr << "BPT Destructor: Root is invalid, not saving config to page 0." << std::endl;
@@ -158,114 +1270,591 @@ namespace RFlowey {
       }
     }
 
+    /**
+     * @brief barrier: the tree as of now is on disk when this returns
+     */
+    void flush() {
+#ifdef BPT_MEMTABLE
+      drain(memtable_);
+#endif
+#ifdef BPT_LAZY_REBALANCE
+      rebalance_pending();
+#endif
+      save_bloom();
+      save_config();
+      manager_.Flush();
+    }
+
+    /**
+     * @brief the manager of the tree's file, for structures that keep their own pages next to the tree
+     */
+    [[nodiscard]] IOManager *io_manager() {
+      return &manager_;
+    }
+
+    /**
+     * @brief one page id such a structure keeps in the tree's config, INVALID_PAGE_ID until set
+     */
+    [[nodiscard]] page_id_t aux_page() const {
+      return aux_page_;
+    }
+    void set_aux_page(page_id_t page_id) {
+      aux_page_ = page_id;
+    }
+
     /**
      * @return a vector of the values correspond to the key;(sorted by the hash of value)
      */
     sjtu::vector<Value> find(const Key &key) {
-      key_type inner_key = {key_hash(key),0};
-      key_type upper = {key_hash(key)+1,0};
-      auto result = find_pos(inner_key, OperationType::FIND);
-      auto leaf = std::move(result.cur_pos.first);
-      auto index = result.cur_pos.second;
-      if(index==INVALID_PAGE_ID) {
-        index=0;
-      }
       sjtu::vector<Value> temp;
-      while (true) {
-        if (index >= leaf->current_size_) {
-          if(leaf->next_node_id_ != INVALID_PAGE_ID) {
-            index = 0;
-            leaf = PagePtr<LeafNode>{leaf->next_node_id_, &manager_}.get_ref();
-            continue;
-          } else {
-            break;
+      find_each(key, [&temp](const Value &value) { temp.push_back(value); });
+      return temp;
+    }
+
+    /**
+     * @brief call f(value) for every value of key, sorted by the hash of value, without building
+     * a result. f must not call into the tree, not even to find: the values it is handed may live
+     * in the result cache or the leaf being read, which a nested call may evict or replace.
+     */
+    template<typename F>
+    void find_each(const Key &key, F &&f) {
+      BPT_LATENCY_SCOPE(find_latency_);
+      assert_not_visiting();
+#ifdef BPT_TEST
+      visiting_ = true;
+      struct Reset {
+        bool &flag;
+        ~Reset() { flag = false; }
+      } reset{visiting_};
+#endif
+      hash_t hash = key_hash(key);
+#ifdef BPT_BLOOM_FILTER
+      if (!bloom_.may_contain(hash)) {
+        return;
+      }
+#endif
+#ifdef BPT_RESULT_CACHE
+      const std::vector<Value> *values = cache_.find(hash, key);
+      if (values == nullptr) {
+        cache_fill_.clear();
+        visit_values(key, {hash,0}, {hash+1,0}, [this](const Value &value) {
+          cache_fill_.push_back(value);
+          return true;
+        });
+        values = cache_.put(hash, key, cache_fill_);
+        if (values == nullptr) {
+          values = &cache_fill_;
+        }
+      }
+      for (const Value &value : *values) {
+        f(value);
+      }
+#else
+      visit_values(key, {hash,0}, {hash+1,0}, [&f](const Value &value) {
+        f(value);
+        return true;
+      });
+#endif
+    }
+
+    /**
+     * @brief write the values of key to out, sorted by the hash of value
+     * @return the iterator past the last value written
+     */
+    template<typename OutputIt> requires (!std::is_integral_v<OutputIt>)
+    OutputIt find(const Key &key, OutputIt out) {
+      find_each(key, [&out](const Value &value) { *out++ = value; });
+      return out;
+    }
+
+    /**
+     * @brief replace the contents of buffer with the values of key, sorted by the hash of value;
+     * the storage of buffer is reused
+     * @return the number of values
+     */
+    template<typename Buffer>
+    size_t find_into(const Key &key, Buffer &buffer) {
+      buffer.clear();
+      find_each(key, [&buffer](const Value &value) { buffer.push_back(value); });
+      return buffer.size();
+    }
+
+    /**
+     * @brief insert {key, value} unless key has a value of the same hash already
+     * @return whether it was inserted
+     */
+    bool insert_if_absent(const Key &key, const Value &value) {
+      BPT_LATENCY_SCOPE(insert_latency_);
+      key_type inner_key = {key_hash(key), value_hash(value)};
+      return modify_entry(inner_key, {key, value}, OperationType::INSERT, [](const value_type *current) {
+        return current == nullptr ? WriteAction::PUT : WriteAction::KEEP;
+      }) == WriteAction::PUT;
+    }
+
+    /**
+     * @brief store value in place of the value of key with the same hash, or insert it if there is none
+     * @return whether it was inserted rather than replaced
+     */
+    bool upsert(const Key &key, const Value &value) {
+      BPT_LATENCY_SCOPE(insert_latency_);
+      key_type inner_key = {key_hash(key), value_hash(value)};
+      bool inserted = false;
+      modify_entry(inner_key, {key, value}, OperationType::INSERT, [&inserted](const value_type *current) {
+        inserted = current == nullptr;
+        return WriteAction::PUT;
+      });
+      return inserted;
+    }
+
+    /**
+     * @brief erase the value of key with the same hash as value if pred(stored value) holds
+     * @return whether it was erased
+     */
+    template<typename Pred>
+    bool erase_if(const Key &key, const Value &value, Pred &&pred) {
+      BPT_LATENCY_SCOPE(erase_latency_);
+      key_type inner_key = {key_hash(key), value_hash(value)};
+#ifdef BPT_BLOOM_FILTER
+      if (!bloom_.may_contain(inner_key.first)) {
+        return false;
+      }
+#endif
+      return modify_entry(inner_key, {key, value}, OperationType::DELETE, [&pred](const value_type *current) {
+        return current != nullptr && pred(current->second) ? WriteAction::ERASE : WriteAction::KEEP;
+      }) == WriteAction::ERASE;
+    }
+
+    /**
+     * @brief a write decided by the values of key, for structures that keep an entry of their own
+     * per key (see PostingBPT): decide(last, count) is handed the value of key with the highest hash,
+     * nullptr if there is none, and the number of values of key. PUT inserts value, ERASE erases the
+     * value of key with the hash of value; type is the descent that write needs, as for modify_entry.
+     * The plain tree decides and writes in one descent unless the values of key span leaves.
+     * @return the action taken, KEEP if there was no value to erase
+     */
+    template<typename Decide>
+    WriteAction modify_key(const Key &key, const Value &value, OperationType type, Decide &&decide) {
+      BPT_LATENCY_SCOPE(type == OperationType::DELETE ? erase_latency_ : insert_latency_);
+      assert_not_visiting();
+      key_type inner_key = {key_hash(key), value_hash(value)};
+      hash_t hash = inner_key.first;
+#ifdef BPT_RESULT_CACHE
+      cache_.invalidate(hash);
+#endif
+#ifdef BPT_BLOOM_FILTER
+      if (bloom_.full()) {
+        rebuild_bloom(bloom_.count());
+      }
+#endif
+      WriteAction action = WriteAction::KEEP;
+      bool decided = false;
+#if !defined(BPT_MEMTABLE) && !defined(BPT_MESSAGE_BUFFER)
+      {
+        //the last entries of hash are in the leaf that the highest key of hash is routed to
+        auto result = find_pos({hash, std::numeric_limits<hash_t>::max()}, type);
+        const LeafNode &leaf = *std::as_const(result.cur_pos.first);
+        size_t end = result.cur_pos.second == INVALID_PAGE_ID ? 0 : result.cur_pos.second + 1;
+        size_t begin = end;
+        while (begin > 0 && leaf.key_at(begin - 1).first == hash) {
+          --begin;
+        }
+        //none are left of this leaf if an entry of a lower hash precedes them or the lower fence is below hash;
+        //then inner_key belongs to this leaf as well
+        if (begin > 0 || result.lower_fence.first < hash) {
+          std::optional<Value> last;
+          size_t count = 0;
+          for (size_t i = begin; i < end; ++i) {
+            const auto &entry = leaf.at(i);
+            if (entry.second.first == key) {
+              last = entry.second.second;
+              ++count;
+            }
+          }
+          decided = true;
+          action = decide(last ? &*last : nullptr, count);
+          index_type index = leaf.search(inner_key);
+          if (action == WriteAction::ERASE && (index == INVALID_PAGE_ID || leaf.key_at(index) != inner_key)) {
+            return WriteAction::KEEP;
+          }
+          result.cur_pos.second = index;
+          if (action == WriteAction::PUT) {
+            insert_entry(std::move(result), inner_key, {key, value});
+          } else if (action == WriteAction::ERASE) {
+            erase_entry(std::move(result), inner_key);
           }
         }
-        if (leaf->at(index).first >= upper) {
-          break;
+      }
+#endif
+      if (!decided) {
+        std::optional<Value> last;
+        size_t count = 0;
+        visit_values(key, {hash,0}, {hash+1,0}, [&](const Value &current) {
+          last = current;
+          ++count;
+          return true;
+        });
+        action = decide(last ? &*last : nullptr, count);
+#if defined(BPT_MEMTABLE) || defined(BPT_MESSAGE_BUFFER)
+#ifdef BPT_MEMTABLE
+        auto &buffer = memtable_;
+#else
+        auto &buffer = buffer_;
+#endif
+        if (action == WriteAction::PUT) {
+          push_message(buffer, {inner_key, {key, value}, MessageOp::INSERT});
+        } else if (action == WriteAction::ERASE && !erase_message(buffer, inner_key, {key, value})) {
+          return WriteAction::KEEP;
         }
-        auto value = leaf->at(index).second;
-        if (value.first == key) {
-          temp.push_back(value.second);
+#else
+        if (action == WriteAction::PUT) {
+          insert_entry(find_pos(inner_key, type), inner_key, {key, value});
+        } else if (action == WriteAction::ERASE && !erase_entry(find_pos(inner_key, type), inner_key)) {
+          return WriteAction::KEEP;
         }
-        ++index;
+#endif
+      }
+#ifdef BPT_BLOOM_FILTER
+      if (action == WriteAction::ERASE) {
+        bloom_.note_erase();
+      } else if (action == WriteAction::PUT) {
+        bloom_.add(hash);
+      }
+#endif
+      return action;
+    }
+
+    /**
+     * @brief erase every value of key in one pass over its leaves
+     * @return the number of values erased
+     */
+    size_t erase_all(const Key &key) {
+      BPT_LATENCY_SCOPE(erase_latency_);
+      hash_t hash = key_hash(key);
+#ifdef BPT_BLOOM_FILTER
+      if (!bloom_.may_contain(hash)) {
+        return 0;
+      }
+#endif
+#ifdef BPT_RESULT_CACHE
+      cache_.invalidate(hash);
+#endif
+      size_t erased = erase_span({hash,0}, {hash+1,0}, [&key](const typename LeafNode::value_type &entry) {
+        return entry.second.first == key;
+      });
+#ifdef BPT_BLOOM_FILTER
+      bloom_.note_erase(erased);
+#endif
+      return erased;
+    }
+
+    /**
+     * @brief erase every value of every key whose hash is in [lower, upper) in one pass over
+     * their leaves; nothing if upper <= lower
+     * @return the number of values erased
+     */
+    size_t erase_range(hash_t lower, hash_t upper) {
+      BPT_LATENCY_SCOPE(erase_latency_);
+      if (upper <= lower) {
+        return 0;
+      }
+#ifdef BPT_RESULT_CACHE
+      cache_.invalidate_range(lower, upper);
+#endif
+      return erase_hashes({lower,0}, {upper,0});
+    }
+
+    /**
+     * @brief erase every value of every key whose hash is at least lower in one pass over their leaves
+     * @return the number of values erased
+     */
+    size_t erase_range(hash_t lower) {
+      BPT_LATENCY_SCOPE(erase_latency_);
+#ifdef BPT_RESULT_CACHE
+      cache_.invalidate_from(lower);
+#endif
+      //erase_span reads an upper of {0,0} as open
+      return erase_hashes({lower,0}, {0,0});
+    }
+
+    /**
+     * @return the first limit values of key, sorted by the hash of value; stops reading at the last of them
+     */
+    sjtu::vector<Value> find(const Key &key, size_t limit) {
+      BPT_LATENCY_SCOPE(find_latency_);
+      sjtu::vector<Value> temp;
+      if (limit == 0) {
+        return temp;
       }
+      visit_key(key, key_hash(key), [&](const Value &value) {
+        temp.push_back(value);
+        return temp.size() < limit;
+      });
       return temp;
     }
 
+    /**
+     * @return whether key has any value; stops at the first one
+     */
+    bool contains(const Key &key) {
+      BPT_LATENCY_SCOPE(find_latency_);
+      bool found = false;
+      visit_key(key, key_hash(key), [&found](const Value &) {
+        found = true;
+        return false;
+      });
+      return found;
+    }
+
+    /**
+     * @return whether key has a value whose hash equals the hash of value (the entry erase would remove)
+     */
+    bool contains(const Key &key, const Value &value) {
+      BPT_LATENCY_SCOPE(find_latency_);
+      key_type inner_key = {key_hash(key), value_hash(value)};
+#ifdef BPT_BLOOM_FILTER
+      if (!bloom_.may_contain(inner_key.first)) {
+        return false;
+      }
+#endif
+      bool found = false;
+      visit_values(key, inner_key, successor(inner_key), [&found](const Value &) {
+        found = true;
+        return false;
+      });
+      return found;
+    }
+
+    /**
+     * @return the number of values of key, without building them
+     */
+    size_t count(const Key &key) {
+      BPT_LATENCY_SCOPE(find_latency_);
+      size_t result = 0;
+      visit_key(key, key_hash(key), [&result](const Value &) {
+        ++result;
+        return true;
+      });
+      return result;
+    }
+
     void insert(const Key &key, const Value &value) {
+      BPT_LATENCY_SCOPE(insert_latency_);
+      assert_not_visiting();
       key_type inner_key = {key_hash(key), value_hash(value)};
-      auto [pos,parents] = find_pos(inner_key, OperationType::INSERT);
-      pos.first->insert_at(pos.second, {{key_hash(key),value_hash(value)}, {key, value}});
-#ifdef BPT_TEST
-      pos.first->current_size_<=LeafNode::SPLIT_T;
+#ifdef BPT_RESULT_CACHE
+      cache_.invalidate(inner_key.first);
 #endif
-      if (parents.empty()) {
-        return;
+#ifdef BPT_BLOOM_FILTER
+      if (bloom_.full()) {
+        rebuild_bloom(bloom_.count());
       }
-      //split on the route
-      auto page_ref = pos.first->split(allocate<LeafNode>(&manager_));
-      auto page_id = page_ref->self_id_;
-      auto first_key = page_ref->get_first();
-      while (!parents.empty()) {
-        auto parent_node = std::move(parents.back().first);
-        auto index = std::move(parents.back().second);
-        parents.pop_back();
-        parent_node->insert_at(index, {first_key, page_id});
-        if (parent_node->current_size_>=InnerNode::SPLIT_T) {
-          auto inner_ref = parent_node->split(allocate<InnerNode>(&manager_));
-          page_id = inner_ref->self_id_;
-          first_key = inner_ref->get_first();
-        } else {
-#ifdef BPT_TEST
-          assert(parents.empty());
+      bloom_.add(inner_key.first);
 #endif
-          //最上面的不应该需要Split,除非是根节点
-          return;
-        }
+#if defined(BPT_MEMTABLE)
+      push_message(memtable_, {inner_key, {key, value}, MessageOp::INSERT});
+#elif defined(BPT_MESSAGE_BUFFER)
+      push_message(buffer_, {inner_key, {key, value}, MessageOp::INSERT});
+#else
+      if (!try_append(inner_key, {key, value})) {
+        insert_entry(find_pos(inner_key, OperationType::INSERT), inner_key, {key, value});
       }
-      //root分裂了，增加新root
-      auto new_ptr = allocate<InnerNode>(&manager_);
-      InnerNode::value_type temp_data[2] = {{{0,0}, root_.page_id()}, {first_key,page_id}};
-      auto new_root = new_ptr.make_ref(InnerNode{new_ptr.page_id(), 2, temp_data});
-      root_ = new_ptr;
-      ++layer;
+#endif
     }
 
 
     bool erase(const Key& key, const Value& value) {
+      BPT_LATENCY_SCOPE(erase_latency_);
+      assert_not_visiting();
       key_type inner_key = {key_hash(key), value_hash(value)};
-      auto [pos,parents] = find_pos(inner_key, OperationType::DELETE);
-      if(pos.second>=pos.first->current_size_||pos.first->at(pos.second).first!=inner_key) {
+#ifdef BPT_RESULT_CACHE
+      cache_.invalidate(inner_key.first);
+#endif
+#ifdef BPT_BLOOM_FILTER
+      if (!bloom_.may_contain(inner_key.first)) {
         return false;
       }
-      pos.first->erase(pos.second);
-      if(parents.empty()) {
-        return true;
+#endif
+#if defined(BPT_MEMTABLE)
+      bool erased = erase_message(memtable_, inner_key, {key, value});
+#elif defined(BPT_MESSAGE_BUFFER)
+      bool erased = erase_message(buffer_, inner_key, {key, value});
+#elif defined(BPT_LAZY_REBALANCE)
+      //the route is only needed by the deferred rebalance
+      bool erased = erase_entry(find_pos(inner_key, OperationType::FIND), inner_key);
+#else
+      bool erased = erase_entry(find_pos(inner_key, OperationType::DELETE), inner_key);
+#endif
+#ifdef BPT_BLOOM_FILTER
+      if (erased) {
+        bloom_.note_erase();
       }
-      if(parents.back().second==0||!pos.first->merge(&manager_)) {
-        return true;
+#endif
+      return erased;
+    }
+
+    /**
+     * @brief find_into(keys[i], results[i]) for every i, in the order of the key hashes, so that each
+     * descent starts from the route of the one before. results grows to keys.size() but is not
+     * shrunk, so that the buffers in it are reused across calls.
+     */
+    template<typename Buffer>
+    void find_many(const std::vector<Key> &keys, std::vector<Buffer> &results) {
+      if (results.size() < keys.size()) {
+        results.resize(keys.size());
       }
-      while (!parents.empty()) {
-        auto parent_node = std::move(parents.back().first);
-        auto index = std::move(parents.back().second);
-        parents.pop_back();
-        parent_node->erase(index);
-        if (parent_node->current_size_<=InnerNode::MERGE_T&&parent_node->prev_node_id_!=INVALID_PAGE_ID) {
-          if(parents.back().second==0||!parent_node->merge(&manager_)) {
-            break;
-          }
-        }else {
-          break;
+      std::vector<std::pair<hash_t, size_t>> order(keys.size());
+      for (size_t i = 0; i < keys.size(); ++i) {
+        order[i] = {key_hash(keys[i]), i};
+      }
+      std::sort(order.begin(), order.end());
+      for (const auto &[hash, i] : order) {
+        find_into(keys[i], results[i]);
+      }
+    }
+
+    /**
+     * @brief insert (keys[i], values[i]) for every i. Without a buffer in front of the tree the pairs
+     * are sorted and applied like a buffer drain, the pairs falling into one leaf with one descent.
+     */
+    void insert_many(const std::vector<Key> &keys, const std::vector<Value> &values) {
+      assert_not_visiting();
+#if defined(BPT_MEMTABLE) || defined(BPT_MESSAGE_BUFFER)
+      for (size_t i = 0; i < keys.size(); ++i) {
+        insert(keys[i], values[i]);
+      }
+#else
+      std::vector<message_type> messages;
+      messages.reserve(keys.size());
+      for (size_t i = 0; i < keys.size(); ++i) {
+        key_type inner_key = {key_hash(keys[i]), value_hash(values[i])};
+#ifdef BPT_RESULT_CACHE
+        cache_.invalidate(inner_key.first);
+#endif
+        messages.push_back({inner_key, {keys[i], values[i]}, MessageOp::INSERT});
+#ifdef BPT_SLOTTED_LEAF
+        //refused before any of the pairs is applied
+        LeafNode::footprint(messages.back().value);
+#endif
+      }
+      std::stable_sort(messages.begin(), messages.end(), [](const message_type &lhs, const message_type &rhs) {
+        return lhs.key < rhs.key;
+      });
+      apply_sorted(messages.data(), messages.size());
+#ifdef BPT_BLOOM_FILTER
+      //after the tree holds the pairs, a rebuild on the way sees them
+      for (const message_type &message : messages) {
+        if (bloom_.full()) {
+          rebuild_bloom(bloom_.count());
         }
+        bloom_.add(message.key.first);
       }
-      auto root = root_.get_ref();
-      if(root->current_size_==1&&layer>0) {
-        root_ = PagePtr<InnerNode>{root->data_[0].second,&manager_};
-        --layer;
-        manager_.DeletePage(root->get_self());
+#endif
+#endif
+    }
+
+    /**
+     * @brief build an empty tree bottom-up from the pairs (keys[i], values[i]): they are sorted on
+     * threads, then each level is written in runs of nodes, one run per thread, from the leaves up.
+     * The nodes are as full as an in-order ingest leaves them. A tree that already has entries
+     * gets the pairs inserted one by one instead.
+     */
+    void bulk_load(const std::vector<Key> &keys, const std::vector<Value> &values,
+                   size_t threads = std::thread::hardware_concurrency()) {
+#ifdef BPT_MEMTABLE
+      drain(memtable_);
+#endif
+      drain(buffer_);
+#ifdef BPT_LAZY_REBALANCE
+      rebalance_pending();
+#endif
+      page_id_t old_root = root_.page_id();
+      page_id_t old_leaf;
+      bool filled;
+      {
+        auto root = root_.get_ref();
+        const InnerNode &node = *std::as_const(root);
+        old_leaf = node.at(0).second;
+        auto leaf = PagePtr<LeafNode>{old_leaf, &manager_}.get_ref();
+        filled = layer != 0 || node.current_size_ != 1 || std::as_const(leaf)->current_size_ != 1;
       }
-      return true;
+      if (filled) {
+        for (size_t i = 0; i < keys.size(); ++i) {
+          insert(keys[i], values[i]);
+        }
+        return;
+      }
+      std::vector<std::pair<key_type, size_t>> order(keys.size());
+      parallel_runs(keys.size(), threads, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+          order[i] = {{key_hash(keys[i]), value_hash(values[i])}, i};
+        }
+      });
+      parallel_sort(order, threads);
+
+      //the leaves, behind the entry {0,0} the leftmost leaf starts with
+      auto leaf_entry = [&](size_t j) -> typename LeafNode::value_type {
+        if (j == 0) {
+          return {{0,0}, {Key{}, Value{}}};
+        }
+        size_t i = order[j - 1].second;
+        return {order[j - 1].first, {keys[i], values[i]}};
+      };
+      std::vector<size_t> bounds = leaf_bounds(keys.size() + 1, leaf_entry);
+      std::vector<page_id_t> ids = reserve_level(bounds.size() - 1);
+      write_level<LeafNode>(ids, bounds, threads, leaf_entry);
+      std::vector<key_type> firsts(ids.size());
+      for (size_t i = 1; i < ids.size(); ++i) {
+        firsts[i] = order[bounds[i] - 1].first;
+      }
+      //the inner levels, each over the first keys of the level below, until one node is left
+      int new_layer = -1;
+      do {
+        bounds = even_bounds(ids.size(), InnerNode::SPLIT_T - 1);
+        std::vector<page_id_t> parent_ids = reserve_level(bounds.size() - 1);
+        write_level<InnerNode>(parent_ids, bounds, threads, [&](size_t j) -> typename InnerNode::value_type {
+          return {firsts[j], child(ids[j])};
+        });
+        for (size_t i = 0; i < parent_ids.size(); ++i) {
+          firsts[i] = firsts[bounds[i]];
+        }
+        firsts.resize(parent_ids.size());
+        ids.swap(parent_ids);
+        ++new_layer;
+      } while (ids.size() > 1);
+
+      manager_.DeletePage(old_leaf);
+      manager_.DeletePage(old_root);
+      root_ = PagePtr<InnerNode>{ids[0], &manager_};
+      layer = new_layer;
+      rightmost_leaf_ = INVALID_PAGE_ID;
+      append_streak_ = 0;
+      on_layer_change();
+#ifdef BPT_BLOOM_FILTER
+      bloom_.reset(2 * keys.size());
+      for (const auto &entry : order) {
+        bloom_.add(entry.first.first);
+      }
+#endif
+#ifdef BPT_RESULT_CACHE
+      cache_.invalidate_from(0);
+#endif
+    }
+
+#ifdef BPT_LATENCY_STATS
+    [[nodiscard]] const LatencyHistogram &find_latency() const { return find_latency_; }
+    [[nodiscard]] const LatencyHistogram &insert_latency() const { return insert_latency_; }
+    [[nodiscard]] const LatencyHistogram &erase_latency() const { return erase_latency_; }
+#endif
+
+    /**
+     * @brief print p50/p99/p999 of every operation; prints nothing unless built with BPT_LATENCY_STATS
+     */
+    void dump_latency([[maybe_unused]] std::ostream &os) const {
+#ifdef BPT_LATENCY_STATS
+      find_latency_.dump(os, "find");
+      insert_latency_.dump(os, "insert");
+      erase_latency_.dump(os, "erase");
+#endif
     }
 
     public: // Add to public section of BPT
@@ -284,8 +1873,56 @@ namespace RFlowey {
 #endif
   }
 
+#ifdef BPT_TEST
+  /**
+   * @brief walk the whole tree, asserting that the keys are ordered and every subtree lies
+   * within the separators around it
+   * @return the smallest size of a node that has a sibling, i.e. could be rebalanced
+   */
+  size_t check_structure() {
+    size_t min_size = std::numeric_limits<size_t>::max();
+    check_node(root_.page_id(), 0, nullptr, nullptr, false, min_size);
+    return min_size;
+  }
+#endif
+
 private: // Add to private section of BPT
 
+#ifdef BPT_TEST
+  void check_node(page_id_t page_id, int depth, const key_type *low, const key_type *high, bool has_sibling, size_t &min_size) {
+    auto check_keys = [&](const auto &node) {
+      assert(node.self_id_ == page_id);
+      if (has_sibling) {
+        min_size = std::min<size_t>(min_size, node.current_size_);
+      }
+      for (size_t i = 0; i < node.current_size_; ++i) {
+        key_type key = node.key_at(i);
+        assert(i == 0 || !(key < key_type(node.key_at(i - 1))));
+        //copies of a key equal to a separator may stay in the leaf left of it
+        assert(high == nullptr || !(*high < key));
+        //the first separator of an inner node may be stale, its child holds the bound
+        assert(low == nullptr || !(key < *low) || (depth <= layer && i == 0));
+      }
+    };
+    if (depth <= layer) {
+      auto ref = PagePtr<InnerNode>{page_id, &manager_}.get_ref();
+      const InnerNode &node = *std::as_const(ref);
+      check_keys(node);
+      for (size_t i = 0; i < node.current_size_; ++i) {
+        key_type separator = node.data_[i].first;
+        key_type next_separator = i + 1 < node.current_size_ ? key_type(node.data_[i + 1].first) : key_type{};
+        check_node(node.data_[i].second, depth + 1,
+                   i == 0 ? low : &separator,
+                   i + 1 < node.current_size_ ? &next_separator : high,
+                   node.current_size_ > 1, min_size);
+      }
+    } else {
+      auto ref = PagePtr<LeafNode>{page_id, &manager_}.get_ref();
+      check_keys(*std::as_const(ref));
+    }
+  }
+#endif
+
   // Recursive helper to print nodes
   void print_node_recursive(page_id_t page_id, int current_depth, bool is_inner_node) {
     if (page_id == INVALID_PAGE_ID) {
@@ -1,7 +1,10 @@
 #ifndef NODE_H
 #define NODE_H
 
+#include <cstdint>
+#include <limits>
 #include <optional>
+#include <stdexcept>
 #include <variant>
 
 #include "disk/IO_manager.h"
@@ -17,6 +20,57 @@ namespace RFlowey {
     Leaf, Inner
   };
 
+  //child page id of a compact inner node (see BPT_COMPACT_INNER); 2^32 pages of 4K are 16T
+  using child_id_t = uint32_t;
+
+  /**
+   * @brief page_id narrowed to a child_id_t
+   * @throw std::overflow_error if the file has outgrown the ids of compact inner nodes
+   */
+  inline child_id_t to_child_id(page_id_t page_id) {
+    if (page_id < 0 || static_cast<unsigned long long>(page_id) > std::numeric_limits<child_id_t>::max()) {
+      throw std::overflow_error("to_child_id: page id does not fit in a compact inner node");
+    }
+    return static_cast<child_id_t>(page_id);
+  }
+
+#pragma pack(push, 4)
+  /**
+   * @brief pair<hash_t,hash_t> aligned to 4 bytes, so that an inner entry with a child_id_t
+   * takes 20 bytes instead of 24. Converts to and from the pair and compares the same way.
+   */
+  struct packed_key {
+    hash_t first;
+    hash_t second;
+
+    packed_key() = default;
+    constexpr packed_key(hash_t first, hash_t second) : first(first), second(second) {}
+    constexpr packed_key(const pair<hash_t, hash_t> &key) : first(key.first), second(key.second) {}
+    constexpr operator pair<hash_t, hash_t>() const {
+      return {first, second};
+    }
+
+    friend constexpr bool operator==(const packed_key &lhs, const packed_key &rhs) {
+      return lhs.first == rhs.first && lhs.second == rhs.second;
+    }
+    friend constexpr bool operator!=(const packed_key &lhs, const packed_key &rhs) {
+      return !(lhs == rhs);
+    }
+    friend constexpr bool operator<(const packed_key &lhs, const packed_key &rhs) {
+      return lhs.first < rhs.first || (lhs.first == rhs.first && lhs.second < rhs.second);
+    }
+    friend constexpr bool operator<=(const packed_key &lhs, const packed_key &rhs) {
+      return !(rhs < lhs);
+    }
+    friend constexpr bool operator>(const packed_key &lhs, const packed_key &rhs) {
+      return rhs < lhs;
+    }
+    friend constexpr bool operator>=(const packed_key &lhs, const packed_key &rhs) {
+      return !(lhs < rhs);
+    }
+  };
+#pragma pack(pop)
+
   template<typename Key, typename Value,PAGETYPE type>
   class BPTNode {
   public:
@@ -63,7 +117,7 @@ namespace RFlowey {
       return l-1;
     }
 
-    [[nodiscard]] value_type at(index_type pos) const {
+    [[nodiscard]] const value_type &at(index_type pos) const {
 #ifdef BPT_TEST
       if (pos >= current_size_) {
         throw std::out_of_range("BPTNode::at: position out of bounds");
@@ -71,6 +125,9 @@ namespace RFlowey {
 #endif
       return data_[pos];
     }
+    [[nodiscard]] const Key &key_at(index_type pos) const {
+      return data_[pos].first;
+    }
     Key& head(index_type pos) {
 #ifdef BPT_TEST
       if (pos >= current_size_) {
@@ -102,6 +159,24 @@ namespace RFlowey {
       current_size_++;
     }
 
+    void push_back(const value_type &value) {
+#ifdef BPT_TEST
+      if (current_size_ >= SIZEMAX) {
+        throw std::overflow_error("BPTNode::push_back: node is full");
+      }
+#endif
+      data_[current_size_++] = value;
+    }
+
+    /**
+     * @brief store value as the value of the entry at pos, keeping its key
+     * @return true; a node of fixed-size entries always has room for it
+     */
+    bool replace(index_type pos, const Value &value) {
+      data_[pos].second = value;
+      return true;
+    }
+
     /**
      * @brief erase the data at pos. pos should be at least 0;
      */
@@ -118,6 +193,34 @@ namespace RFlowey {
       current_size_--;
     }
 
+    /**
+     * @brief erase every entry for which pred(entry) holds, keeping the others in order
+     * @return the number of entries erased
+     */
+    template<typename Pred>
+    size_t erase_if(Pred &&pred) {
+      size_t kept = 0;
+      for (size_t i = 0; i < current_size_; ++i) {
+        if (pred(std::as_const(data_[i]))) {
+          continue;
+        }
+        if (kept != i) {
+          data_[kept] = data_[i];
+        }
+        ++kept;
+      }
+      size_t erased = current_size_ - kept;
+      current_size_ = kept;
+      return erased;
+    }
+
+    //how full the node is, in the unit its thresholds are in
+    [[nodiscard]] size_t load() const {
+      return current_size_;
+    }
+    [[nodiscard]] bool is_underfull() const {
+      return current_size_ <= MERGE_T;
+    }
     [[nodiscard]] bool is_safe() const {
       return current_size_<SPLIT_T-1 && current_size_>MERGE_T+1;
     }
@@ -125,12 +228,20 @@ namespace RFlowey {
       return current_size_<SPLIT_T-1;
     }
     [[nodiscard]] bool is_lower_safe() const {
-      return current_size_>MERGE_T+1 || prev_node_id_==INVALID_PAGE_ID;
+      return current_size_>MERGE_T+1;
     }
 
     PageRef<BPTNode> split(const PagePtr<BPTNode>& ptr) {
+      return split(ptr, current_size_/2);
+    }
+
+    /**
+     * @param mid the number of entries kept in this node, the rest move to the new node at ptr
+     */
+    PageRef<BPTNode> split(const PagePtr<BPTNode>& ptr, size_t mid) {
 #ifdef BPT_TEST
       assert(current_size_>=SPLIT_T);
+      assert(mid > 0 && mid < current_size_);
 #endif
       std::unique_ptr<BPTNode> temp = std::make_unique<BPTNode>(*this);
 
@@ -143,7 +254,6 @@ namespace RFlowey {
       temp->self_id_ = ptr.page_id();
 
 
-      int mid = current_size_/2;
       std::memmove(temp->data_,temp->data_+mid,(current_size_-mid)*sizeof(value_type));
       temp->current_size_ = current_size_-mid;
       current_size_ = mid;
@@ -156,26 +266,84 @@ namespace RFlowey {
       assert(prev_node_id_!=INVALID_PAGE_ID);
 #endif
       auto prev_node = PagePtr<BPTNode>{prev_node_id_,manager}.get_ref();
-      if(prev_node->current_size_+current_size_>=SIZEMAX-1) {
+      return prev_node->absorb(*this, manager);
+    }
+
+    /**
+     * @brief append the right neighbour `right` to this node and free its page
+     * @return false if both do not fit into one node
+     */
+    bool absorb(BPTNode &right, IOManager* manager) {
+#ifdef BPT_TEST
+      assert(right.prev_node_id_==self_id_ && next_node_id_==right.self_id_);
+#endif
+      if(current_size_+right.current_size_>=SIZEMAX-1) {
         return false;
       }
-      if(next_node_id_!=INVALID_PAGE_ID) {
-        auto next_node = PagePtr<BPTNode>{next_node_id_,manager}.get_ref();
-        next_node->prev_node_id_ = prev_node_id_;
+      if(right.next_node_id_!=INVALID_PAGE_ID) {
+        auto next_node = PagePtr<BPTNode>{right.next_node_id_,manager}.get_ref();
+        next_node->prev_node_id_ = self_id_;
       }
-      std::memcpy(prev_node->data_+prev_node->current_size_,data_,current_size_*sizeof(value_type));
-      prev_node->current_size_ += current_size_;
-      prev_node->next_node_id_ = next_node_id_;
-      manager->DeletePage(self_id_);
+      std::memcpy(data_+current_size_,right.data_,right.current_size_*sizeof(value_type));
+      current_size_ += right.current_size_;
+      next_node_id_ = right.next_node_id_;
+      manager->DeletePage(right.self_id_);
       return true;
     }
 
+    /**
+     * @brief move the last count entries of the left neighbour to the front of this node
+     */
+    void borrow_from_left(BPTNode &left, size_t count) {
+#ifdef BPT_TEST
+      assert(count < left.current_size_ && current_size_+count < SIZEMAX);
+#endif
+      std::memmove(data_+count,data_,current_size_*sizeof(value_type));
+      std::memcpy(data_,left.data_+left.current_size_-count,count*sizeof(value_type));
+      left.current_size_ -= count;
+      current_size_ += count;
+    }
+
+    /**
+     * @brief move entries over from the fuller left neighbour until both hold about as many
+     */
+    void borrow_from_left(BPTNode &left) {
+      borrow_from_left(left, (left.current_size_ - current_size_) / 2);
+    }
+
+    /**
+     * @brief move the first count entries of the right neighbour to the end of this node
+     */
+    void borrow_from_right(BPTNode &right, size_t count) {
+#ifdef BPT_TEST
+      assert(count < right.current_size_ && current_size_+count < SIZEMAX);
+#endif
+      std::memcpy(data_+current_size_,right.data_,count*sizeof(value_type));
+      std::memmove(right.data_,right.data_+count,(right.current_size_-count)*sizeof(value_type));
+      right.current_size_ -= count;
+      current_size_ += count;
+    }
+
+    /**
+     * @brief move entries over from the fuller right neighbour until both hold about as many
+     */
+    void borrow_from_right(BPTNode &right) {
+      borrow_from_right(right, (right.current_size_ - current_size_) / 2);
+    }
+
 
 
     [[nodiscard]] page_id_t get_self() const {
       return self_id_;
     }
 
+    /**
+     * @brief the page format of the node, folded into the layout fingerprint of BPT
+     */
+    static constexpr hash_t layout() {
+      return mix(mix(mix(type) ^ sizeof(value_type)) ^ SIZEMAX);
+    }
+
   };
 }
 
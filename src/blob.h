@@ -0,0 +1,164 @@
+#ifndef BLOB_H
+#define BLOB_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "BPT.h"
+
+namespace RFlowey {
+
+  /**
+   * @brief one page of a value stored out of line; the pages of a value are chained by next_page_id_,
+   * and so are the pages of the free list
+   */
+  class BlobPage {
+  public:
+    static constexpr size_t CAPACITY = PAGESIZE - sizeof(page_id_t);
+
+    page_id_t next_page_id_ = INVALID_PAGE_ID;
+    char data_[CAPACITY];
+  };
+
+  /**
+   * @brief where a value stored out of line lives; this is what the leaves hold
+   */
+  struct BlobHandle {
+    hash_t hash = 0;
+    page_id_t head = INVALID_PAGE_ID;
+    size_t length = 0;
+  };
+
+  /**
+   * @brief a multimap from keys to byte strings of any length, with the interface of BPT.
+   * The leaves hold a 24-byte handle per value, the bytes live in chained BlobPages of the same
+   * file. The pages of an erased value go to a free list, reused by later inserts before the
+   * file grows; its head is kept in the tree's config.
+   */
+  template<typename Key, typename KeyHash = std::hash<Key>, typename ValueHash = std::hash<std::string>>
+  class BlobBPT {
+    struct HandleHash {
+      hash_t operator()(const BlobHandle &handle) const {
+        return handle.hash;
+      }
+    };
+
+    BPT<Key, BlobHandle, KeyHash, HandleHash> tree_;
+    ValueHash value_hash{};
+    page_id_t free_head_ = INVALID_PAGE_ID;
+
+    page_id_t allocate_page() {
+      if (free_head_ == INVALID_PAGE_ID) {
+        return tree_.io_manager()->NewPage();
+      }
+      page_id_t page_id = free_head_;
+      free_head_ = PagePtr<BlobPage>{page_id, tree_.io_manager()}.get_ref()->next_page_id_;
+      return page_id;
+    }
+
+    page_id_t write_value(const std::string &value) {
+      page_id_t head = INVALID_PAGE_ID;
+      PageRef<BlobPage> prev;
+      size_t offset = 0;
+      do {
+        PagePtr<BlobPage> ptr{allocate_page(), tree_.io_manager()};
+        auto ref = ptr.make_ref();
+        size_t count = std::min(BlobPage::CAPACITY, value.size() - offset);
+        std::memcpy(ref->data_, value.data() + offset, count);
+        offset += count;
+        if (head == INVALID_PAGE_ID) {
+          head = ptr.page_id();
+        } else {
+          prev->next_page_id_ = ptr.page_id();
+        }
+        prev = std::move(ref);
+      } while (offset < value.size());
+      return head;
+    }
+
+    std::string read_value(const BlobHandle &handle) {
+      std::string value(handle.length, '\0');
+      size_t offset = 0;
+      for (page_id_t id = handle.head; id != INVALID_PAGE_ID;) {
+        auto ref = PagePtr<BlobPage>{id, tree_.io_manager()}.get_ref();
+        const BlobPage &page = *std::as_const(ref);
+        size_t count = std::min(BlobPage::CAPACITY, handle.length - offset);
+        std::memcpy(value.data() + offset, page.data_, count);
+        offset += count;
+        id = page.next_page_id_;
+      }
+      return value;
+    }
+
+    void free_value(const BlobHandle &handle) {
+      page_id_t id = handle.head;
+      while (true) {
+        auto ref = PagePtr<BlobPage>{id, tree_.io_manager()}.get_ref();
+        page_id_t next = std::as_const(ref)->next_page_id_;
+        ref->next_page_id_ = free_head_;
+        free_head_ = id;
+        if (next == INVALID_PAGE_ID) {
+          break;
+        }
+        id = next;
+      }
+    }
+
+  public:
+    explicit BlobBPT(const std::string &file_name) : tree_(file_name) {
+      free_head_ = tree_.aux_page();
+    }
+
+    ~BlobBPT() {
+      tree_.set_aux_page(free_head_);
+    }
+
+    /**
+     * @return a vector of the values correspond to the key;(sorted by the hash of value)
+     * std::vector, since sjtu::vector relocates its elements with memcpy
+     */
+    std::vector<std::string> find(const Key &key) {
+      std::vector<std::string> result;
+      auto handles = tree_.find(key);
+      for (size_t i = 0; i < handles.size(); ++i) {
+        result.push_back(read_value(handles[i]));
+      }
+      return result;
+    }
+
+    void insert(const Key &key, const std::string &value) {
+      tree_.insert(key, BlobHandle{value_hash(value), write_value(value), value.size()});
+    }
+
+    /**
+     * @brief erase one value whose hash equals the hash of value
+     * @return false if the key has no such value
+     */
+    bool erase(const Key &key, const std::string &value) {
+      hash_t hash = value_hash(value);
+      auto handles = tree_.find(key);
+      //handles of one hash are equal to the tree, which erases the last of them
+      for (size_t i = handles.size(); i-- > 0;) {
+        if (handles[i].hash == hash) {
+          if (!tree_.erase(key, handles[i])) {
+            return false;
+          }
+          free_value(handles[i]);
+          return true;
+        }
+      }
+      return false;
+    }
+
+    /**
+     * @brief barrier: the tree, the values and the free list as of now are on disk when this returns
+     */
+    void flush() {
+      tree_.set_aux_page(free_head_);
+      tree_.flush();
+    }
+  };
+}
+
+#endif //BLOB_H
@@ -0,0 +1,171 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "disk/IO_manager.h"
+#include "disk/IO_utils.h"
+#include "src/common.h"
+#include "src/utils/utils.h"
+
+namespace RFlowey {
+
+  /**
+   * @brief one page of a BloomFilter; the pages of a filter are chained by next_page_id_
+   */
+  class BloomPage {
+  public:
+#ifndef BPT_SMALL_SIZE
+    static constexpr size_t WORDS = (PAGESIZE - 4 * sizeof(size_t)) / sizeof(uint64_t);
+#else
+    static constexpr size_t WORDS = 4;
+#endif
+
+    page_id_t self_id_ = INVALID_PAGE_ID;
+    page_id_t next_page_id_ = INVALID_PAGE_ID;
+    //counters of the whole filter, kept on its first page
+    size_t count_ = 0;
+    size_t erased_ = 0;
+
+    uint64_t bits_[WORDS]{};
+
+    explicit BloomPage(page_id_t self_id) : self_id_(self_id) {}
+  };
+
+  /**
+   * @brief approximate set of key hashes: may_contain is false only for a hash never added
+   * since the last reset. Held in memory and saved to a chain of pages; save writes the pages
+   * changed since the last save.
+   */
+  class BloomFilter {
+    IOManager *manager_ = nullptr;
+    std::vector<uint64_t> bits_;
+    std::vector<page_id_t> pages_;
+    std::vector<bool> dirty_;
+    //hashes added and erases seen since the last reset
+    size_t count_ = 0;
+    size_t erased_ = 0;
+
+    template<typename F>
+    void probe(hash_t hash, F &&f) const {
+      uint64_t h1 = mix(hash);
+      uint64_t h2 = mix(h1) | 1;
+      uint64_t bits = bits_.size() * 64;
+      for (int i = 0; i < BLOOM_PROBES; ++i) {
+        f(static_cast<size_t>((static_cast<unsigned __int128>(h1 + i * h2) * bits) >> 64));
+      }
+    }
+
+  public:
+    /**
+     * @return false if there is no saved filter at head
+     */
+    bool open(IOManager *manager, page_id_t head) {
+      manager_ = manager;
+      for (page_id_t id = head; id != INVALID_PAGE_ID;) {
+        auto ref = PagePtr<BloomPage>{id, manager_}.get_ref();
+        const BloomPage &page = *std::as_const(ref);
+        if (pages_.empty()) {
+          count_ = page.count_;
+          erased_ = page.erased_;
+        }
+        pages_.push_back(id);
+        bits_.insert(bits_.end(), page.bits_, page.bits_ + BloomPage::WORDS);
+        id = page.next_page_id_;
+      }
+      dirty_.assign(pages_.size(), false);
+      return !pages_.empty();
+    }
+
+    [[nodiscard]] page_id_t head() const {
+      return pages_.empty() ? INVALID_PAGE_ID : pages_.front();
+    }
+
+    /**
+     * @brief clear the filter, sized for expected hashes at BLOOM_BITS_PER_KEY
+     */
+    void reset(size_t expected) {
+      size_t words = std::max<size_t>((expected * BLOOM_BITS_PER_KEY + 63) / 64, 1);
+      size_t page_count = (words + BloomPage::WORDS - 1) / BloomPage::WORDS;
+      bits_.assign(page_count * BloomPage::WORDS, 0);
+      //the pages of the old filter are reused, save allocates the missing ones
+      while (pages_.size() > page_count) {
+        manager_->DeletePage(pages_.back());
+        pages_.pop_back();
+      }
+      dirty_.assign(page_count, true);
+      count_ = 0;
+      erased_ = 0;
+    }
+
+    void add(hash_t hash) {
+      probe(hash, [this](size_t bit) {
+        bits_[bit / 64] |= 1ull << (bit % 64);
+        dirty_[bit / 64 / BloomPage::WORDS] = true;
+      });
+      ++count_;
+    }
+
+    [[nodiscard]] bool may_contain(hash_t hash) const {
+      bool result = true;
+      probe(hash, [&](size_t bit) {
+        result = result && (bits_[bit / 64] >> (bit % 64) & 1);
+      });
+      return result;
+    }
+
+    /**
+     * @brief erased hashes keep their bits until the next reset
+     */
+    void note_erase(size_t count = 1) {
+      erased_ += count;
+    }
+
+    /**
+     * @return whether more hashes were added than the filter was sized for
+     */
+    [[nodiscard]] bool full() const {
+      return count_ * BLOOM_BITS_PER_KEY > bits_.size() * 64;
+    }
+    /**
+     * @return whether most of the added hashes may be gone
+     */
+    [[nodiscard]] bool stale() const {
+      return erased_ * 2 > count_;
+    }
+    [[nodiscard]] size_t count() const {
+      return count_;
+    }
+    /**
+     * @return the hashes added less the erases seen
+     */
+    [[nodiscard]] size_t live() const {
+      return count_ - std::min(erased_, count_);
+    }
+
+    void save() {
+      while (pages_.size() * BloomPage::WORDS < bits_.size()) {
+        pages_.push_back(manager_->NewPage());
+      }
+      for (size_t i = 0; i < pages_.size(); ++i) {
+        //the counters on the first page change with every insert
+        if (!dirty_[i] && i != 0) {
+          continue;
+        }
+        auto page = std::make_unique<BloomPage>(pages_[i]);
+        page->next_page_id_ = i + 1 < pages_.size() ? pages_[i + 1] : INVALID_PAGE_ID;
+        page->count_ = count_;
+        page->erased_ = erased_;
+        std::memcpy(page->bits_, bits_.data() + i * BloomPage::WORDS, sizeof(page->bits_));
+        PagePtr<BloomPage>{pages_[i], manager_}.make_ref(std::move(page));
+        dirty_[i] = false;
+      }
+    }
+  };
+}
+
+#endif //BLOOM_H
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+
 
 
 namespace RFlowey {
@@ -13,6 +15,28 @@ namespace RFlowey {
   using index_type = unsigned long;
   constexpr int PAGESIZE = 4096;
   constexpr page_id_t INVALID_PAGE_ID=-1;
+  //number of inner layers (counting the root) kept resident in memory by BPT
+  constexpr int PINNED_LAYERS = 2;
+  //consecutive inserts at the end of the tree after which a full rightmost node splits 100/0
+  constexpr int APPEND_STREAK = 4;
+  //underfull leaves queued by erase before they are rebalanced, see BPT_LAZY_REBALANCE
+  constexpr size_t REBALANCE_BATCH = 64;
+  //write-back policy of the disk manager (see WriteBackBuffer)
+  constexpr size_t FLUSH_BATCH_PAGES = 256;
+  constexpr size_t FLUSH_MAX_PAGES = 4096;
+  constexpr int FLUSH_INTERVAL_MS = 50;
+  //pages of the message buffer in front of the tree (see MessageBuffer)
+  constexpr size_t MESSAGE_BUFFER_PAGES = 64;
+  //memory budget of the in-memory write buffer in front of the tree (see MemTable)
+  constexpr size_t MEMTABLE_BUDGET = 4 << 20;
+  //values a key keeps as separate tree entries before they move to a posting list (see PostingBPT)
+  constexpr size_t POSTING_INLINE_MAX = 32;
+  //bits per key and probes of the filter in front of the tree (see BPT_BLOOM_FILTER), about 1% false positives
+  constexpr size_t BLOOM_BITS_PER_KEY = 10;
+  constexpr int BLOOM_PROBES = 7;
+  //keys whose values are cached in front of the tree, and the most values a cached key may have (see ResultCache)
+  constexpr size_t RESULT_CACHE_ENTRIES = 4096;
+  constexpr size_t RESULT_CACHE_MAX_VALUES = 64;
 
   //Global manager for Disk(unused)
   //inline IOManager* manager;
@@ -6,16 +6,51 @@ namespace RFlowey {
 
   IOManager::~IOManager() = default;
 
+  void IOManager::Flush() {}
+
+  std::shared_ptr<Page> IOManager::Pin(page_id_t page_id) {
+    auto it = pinned_.find(page_id);
+    if (it != pinned_.end()) {
+      return it->second;
+    }
+    auto page = ReadPage(page_id);
+    pinned_.emplace(page_id, page);
+    return page;
+  }
+  void IOManager::Unpin(page_id_t page_id) {
+    if (pinned_.erase(page_id)) {
+      ++residency_epoch_;
+    }
+  }
+  //must be called by the derived destructors: releasing a page writes it back through WritePage
+  void IOManager::UnpinAll() {
+    pinned_.clear();
+    ++residency_epoch_;
+  }
+  std::shared_ptr<Page> IOManager::Pinned(page_id_t page_id) const {
+    auto it = pinned_.find(page_id);
+    return it == pinned_.end() ? nullptr : it->second;
+  }
+  size_t IOManager::PinnedCount() const {
+    return pinned_.size();
+  }
+  uint64_t IOManager::ResidencyEpoch() const {
+    return residency_epoch_;
+  }
+
   //--------Memory version-------
   MemoryManager::MemoryManager(const std::string &file_name) {
     return;
   }
+  MemoryManager::~MemoryManager() {
+    UnpinAll();
+  }
 
   page_id_t MemoryManager::NewPage() {
     return ++next_page_;
   }
   void MemoryManager::DeletePage(page_id_t page_id) {
-    return;
+    Unpin(page_id);
   }
   std::shared_ptr<Page> MemoryManager::ReadPage(page_id_t page_id) {
     auto temp = std::make_shared<Page>(this,page_id);
@@ -29,14 +64,17 @@ namespace RFlowey {
 
 
   //--------Disk version-------
-  SimpleDiskManager::SimpleDiskManager(const std::string& file_name) {
+  SimpleDiskManager::SimpleDiskManager(const std::string& file_name)
+    : write_back_([this](page_id_t first, const char* data, size_t count) { WriteRun(first, data, count); }) {
     is_new = open(file_,file_name);
     if(!is_new) {
-      auto meta = SimpleDiskManager::ReadPage(0);
-      next_page_ = *reinterpret_cast<page_id_t*>(meta->get_data());
+      file_.seekg(0);
+      file_.read(reinterpret_cast<char*>(&next_page_),sizeof(page_id_t));
     }
   };
   SimpleDiskManager::~SimpleDiskManager(){
+    UnpinAll();
+    write_back_.Stop();
     file_.seekp(0);
     file_.write(reinterpret_cast<const char*>(&next_page_),sizeof(page_id_t));
   }
@@ -45,7 +83,7 @@ namespace RFlowey {
     return ++next_page_;
   }
   void SimpleDiskManager::DeletePage(page_id_t page_id) {
-    return;
+    Unpin(page_id);
   }
   std::shared_ptr<Page> SimpleDiskManager::ReadPage(page_id_t page_id) {
 #ifdef BPT_TEST
@@ -59,8 +97,13 @@ namespace RFlowey {
 
     auto temp = std::make_shared<Page>(this, page_id);
     char* page_data = temp->get_data();
+    //a page waiting in the write-back buffer is newer than the file
+    if (write_back_.Get(page_id, page_data)) {
+      return temp;
+    }
     std::streamoff offset = static_cast<std::streamoff>(page_id) * PAGESIZE;
 
+    std::lock_guard lock(file_mutex_);
     file_.seekg(offset);
 #ifdef BPT_TEST
     if (file_.fail()) {
@@ -93,23 +136,39 @@ namespace RFlowey {
         throw std::out_of_range("SimpleDiskManager: Invalid page_id for WritePage (must be > 0): " + std::to_string(page_id));
     }
 #endif
-    char* page_data = page.get_data();
-    std::streamoff offset = static_cast<std::streamoff>(page_id) * PAGESIZE;
+    write_back_.Put(page_id, page.get_data());
+  }
+
+  /**
+   * @brief called by the write-back buffer with a run of adjacent pages
+   */
+  void SimpleDiskManager::WriteRun(page_id_t first, const char* data, size_t count) {
+    std::streamoff offset = static_cast<std::streamoff>(first) * PAGESIZE;
 
+    std::lock_guard lock(file_mutex_);
     file_.seekp(offset);
 #ifdef BPT_TEST
     if (file_.fail()) {
         file_.clear();
-        throw std::runtime_error("SimpleDiskManager: Failed to seek to page " + std::to_string(page_id) +
+        throw std::runtime_error("SimpleDiskManager: Failed to seek to page " + std::to_string(first) +
                                  " (offset " + std::to_string(offset) + ") for writing.");
     }
 #endif
-    file_.write(page_data, PAGESIZE);
+    file_.write(data, static_cast<std::streamsize>(count * PAGESIZE));
 #ifdef BPT_TEST
     if (file_.fail()) {
         file_.clear();
-        throw std::runtime_error("SimpleDiskManager: Failed to write page " + std::to_string(page_id));
+        throw std::runtime_error("SimpleDiskManager: Failed to write pages " + std::to_string(first) +
+                                 "+" + std::to_string(count));
     }
 #endif
   }
+
+  void SimpleDiskManager::Flush() {
+    write_back_.Flush();
+    std::lock_guard lock(file_mutex_);
+    file_.seekp(0);
+    file_.write(reinterpret_cast<const char*>(&next_page_),sizeof(page_id_t));
+    file_.flush();
+  }
 }
\ No newline at end of file
@@ -2,7 +2,10 @@
 
 #include <fstream>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 #include "src/common.h"
+#include "write_back.h"
 
 
 
@@ -17,7 +20,32 @@ namespace RFlowey {
     virtual void DeletePage(page_id_t page_id) = 0;
     virtual std::shared_ptr<Page> ReadPage(page_id_t page_id) = 0;
     virtual void WritePage(Page& page,page_id_t page_id) = 0;
-    
+    /**
+     * @brief barrier: every page written before the call reaches the file
+     */
+    virtual void Flush();
+
+    /**
+     * @brief keep the page resident. Later get_ref() of it views the same in-memory Page
+     * instead of reading and decoding a copy, and modifications are written through.
+     */
+    std::shared_ptr<Page> Pin(page_id_t page_id);
+    void Unpin(page_id_t page_id);
+    void UnpinAll();
+    /**
+     * @return the resident page, or nullptr if it is not pinned
+     */
+    [[nodiscard]] std::shared_ptr<Page> Pinned(page_id_t page_id) const;
+    [[nodiscard]] size_t PinnedCount() const;
+    /**
+     * @brief advanced whenever a pinned page is released; raw pointers to resident pages
+     * (see Page::swizzled) taken in an older epoch may dangle
+     */
+    [[nodiscard]] uint64_t ResidencyEpoch() const;
+
+  protected:
+    std::unordered_map<page_id_t, std::shared_ptr<Page>> pinned_;
+    uint64_t residency_epoch_ = 1;
   };
 
   class MemoryManager:public IOManager {
@@ -28,6 +56,7 @@ namespace RFlowey {
     bool is_new = true;
     MemoryManager() = default;
     explicit MemoryManager(const std::string& file_name);
+    ~MemoryManager() override;
 
     page_id_t NewPage() override;
     void DeletePage(page_id_t page_id) override;
@@ -38,7 +67,11 @@ namespace RFlowey {
 
   class SimpleDiskManager:public IOManager {
     std::fstream file_;
+    std::mutex file_mutex_;
     page_id_t next_page_=1;//0 reserved
+    WriteBackBuffer write_back_;
+
+    void WriteRun(page_id_t first, const char* data, size_t count);
 
   public:
     bool is_new = true;
@@ -49,5 +82,6 @@ namespace RFlowey {
     void DeletePage(page_id_t page_id) override;
     std::shared_ptr<Page> ReadPage(page_id_t page_id) override;
     void WritePage(Page& page,page_id_t page_id) override;
+    void Flush() override;
   };
 }
\ No newline at end of file
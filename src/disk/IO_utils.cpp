@@ -8,16 +8,45 @@ namespace RFlowey {
   Page::Page(IOManager* manager,page_id_t page_id):manager_(manager), page_id_(page_id){};
 
   Page::~Page() {
-    flush();
+    if(dirty_) {
+      flush();
+    }
   };
 
   char* Page::get_data() {
     return data_;
   }
+  page_id_t Page::page_id() const {
+    return page_id_;
+  }
+  void Page::mark_dirty() {
+    dirty_ = true;
+  }
   void Page::flush() {
     if(manager_) {
       manager_->WritePage(*this,page_id_);
     }
+    dirty_ = false;
+  }
+
+  Page* Page::swizzled(index_type slot, uint64_t epoch) {
+    if (epoch != swizzle_epoch_) {
+      //some resident page was released since these pointers were taken
+      swizzled_.clear();
+      swizzle_epoch_ = epoch;
+      return nullptr;
+    }
+    return slot < swizzled_.size() ? swizzled_[slot] : nullptr;
+  }
+  void Page::swizzle(index_type slot, Page* child, uint64_t epoch) {
+    if (epoch != swizzle_epoch_) {
+      swizzled_.clear();
+      swizzle_epoch_ = epoch;
+    }
+    if (slot >= swizzled_.size()) {
+      swizzled_.resize(slot + 1, nullptr);
+    }
+    swizzled_[slot] = child;
   }
 
 
@@ -1,8 +1,11 @@
 #ifndef IO_UTILS_H
 #define IO_UTILS_H
 
+#include <cstddef>
 #include <fstream>
 #include <memory>
+#include <new>
+#include <vector>
 #include <src/disk/serialize.h>
 
 #include "IO_manager.h"
@@ -14,17 +17,32 @@ namespace RFlowey {
   /**
    * A wrapper of a Byte Page(Temporary solution for no Buffer Pool)
    * Ensure the life span covers the value of it
+   * Only a page marked dirty is written back on destruction
    */
-  class Page {
-    char data_[4096]={};
+  class Page : public std::enable_shared_from_this<Page> {
+    alignas(std::max_align_t) char data_[4096]={};
     page_id_t page_id_;
     IOManager* manager_;
+    bool dirty_ = false;
+    //swizzled child references of a resident page: direct pointers to the resident pages of the
+    //children, indexed like the entries on this page. The data itself always keeps page ids.
+    std::vector<Page*> swizzled_;
+    uint64_t swizzle_epoch_ = 0;
   public:
     Page() = delete;
     Page(IOManager* manager,page_id_t page_id);
     ~Page();
     char* get_data();
+    [[nodiscard]] page_id_t page_id() const;
+    //a dirty page is written back when it is destroyed
+    void mark_dirty();
     void flush();
+
+    /**
+     * @return the swizzled child at slot, nullptr if there is none or the residency epoch moved on
+     */
+    Page* swizzled(index_type slot, uint64_t epoch);
+    void swizzle(index_type slot, Page* child, uint64_t epoch);
   };
   bool open(std::fstream& file,std::string& filename);
 
@@ -50,18 +68,27 @@ namespace RFlowey {
 
 
   //代表“解引用”后的内存中的对象，析构时会同时析构并重新序列化管理的对象
+  //对于常驻(pinned)的页，直接在页内存上访问对象，修改后立即写回(write-through)
   template<typename T>
   class PageRef {
     std::shared_ptr<Page> page_;
     std::unique_ptr<T> t_ptr_;
+    T* view_ = nullptr;
     bool is_dirty = false;
     bool is_valid = true;
   public:
     PageRef() = default;
-    PageRef(std::shared_ptr<Page> page,std::unique_ptr<T>&& t_ptr):page_(std::move(page)),t_ptr_(std::move(t_ptr)){};
-    PageRef(PageRef&& ref) noexcept :page_(std::move(ref.page_)),t_ptr_(std::move(ref.t_ptr_)) {
+    PageRef(std::shared_ptr<Page> page,std::unique_ptr<T>&& t_ptr):page_(std::move(page)),t_ptr_(std::move(t_ptr)),view_(t_ptr_.get()){};
+    /**
+     * @brief view an object living inside a resident page
+     */
+    explicit PageRef(std::shared_ptr<Page> page):page_(std::move(page)) {
+      view_ = std::launder(reinterpret_cast<T*>(page_->get_data()));
+    }
+    PageRef(PageRef&& ref) noexcept :page_(std::move(ref.page_)),t_ptr_(std::move(ref.t_ptr_)),view_(ref.view_) {
       is_dirty = ref.is_dirty;
       is_valid = ref.is_valid;
+      ref.view_ = nullptr;
       ref.is_dirty = false;
       ref.is_valid = false;
     };
@@ -74,8 +101,10 @@ namespace RFlowey {
 
       page_ = std::move(ref.page_);
       t_ptr_ = std::move(ref.t_ptr_);
+      view_ = ref.view_;
       is_dirty = ref.is_dirty;
       is_valid = ref.is_valid;
+      ref.view_ = nullptr;
       ref.is_dirty = false;
       ref.is_valid = false;
 
@@ -93,24 +122,32 @@ namespace RFlowey {
         return;
       }
       if(is_dirty) {
-        Serialize(page_->get_data(),*t_ptr_);
+        if(t_ptr_) {
+          Serialize(page_->get_data(),*t_ptr_);
+          page_->mark_dirty();
+        } else {
+          page_->flush();
+        }
       }
       is_valid = false;
 
     }
+    [[nodiscard]] bool is_resident() const {
+      return t_ptr_ == nullptr;
+    }
     T* operator->() {
       is_dirty = true;
-      return t_ptr_.get();
+      return view_;
     }
     const T* operator->() const{
-      return t_ptr_.get();
+      return view_;
     }
     T& operator*() {
       is_dirty = true;
-      return *t_ptr_;
+      return *view_;
     }
     const T& operator*() const{
-      return *t_ptr_;
+      return *view_;
     }
   };
   template<typename T>
@@ -127,6 +164,9 @@ namespace RFlowey {
 
     //get an ref to an EXISTING object on the page;
     [[nodiscard]] PageRef<T> get_ref() const {
+      if (auto resident = manager_->Pinned(page_id_)) {
+        return PageRef<T>{std::move(resident)};
+      }
       std::shared_ptr<Page> page = manager_->ReadPage(page_id_);
       return PageRef{page,Deserialize<T>(page->get_data())};
     }
@@ -136,6 +176,11 @@ namespace RFlowey {
       return make_ref(std::make_unique<T>(std::forward<Args>(args)...));
     }
     PageRef<T> make_ref(std::unique_ptr<T> t_obj_ptr) const {
+      if (auto resident = manager_->Pinned(page_id_)) {
+        Serialize(resident->get_data(), *t_obj_ptr);
+        resident->flush();
+        return PageRef<T>{std::move(resident)};
+      }
       auto page = std::make_shared<Page>(manager_, page_id_);
       Serialize(page->get_data(), *t_obj_ptr);
       page->flush();
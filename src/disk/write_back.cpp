@@ -0,0 +1,135 @@
+#include "write_back.h"
+
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+namespace RFlowey {
+  WriteBackBuffer::WriteBackBuffer(Writer writer, bool background)
+    : writer_(std::move(writer)), background_(background) {
+    if (background_) {
+      thread_ = std::thread([this] { Run(); });
+    }
+  }
+
+  WriteBackBuffer::~WriteBackBuffer() {
+    Stop();
+  }
+
+  void WriteBackBuffer::Put(page_id_t page_id, const char* data) {
+    std::unique_lock lock(mutex_);
+    if (stopped_) {
+      lock.unlock();
+      writer_(page_id, data, 1);
+      return;
+    }
+    if (background_) {
+      drained_.wait(lock, [&] { return dirty_.size() < FLUSH_MAX_PAGES || dirty_.contains(page_id); });
+    }
+    auto& slot = dirty_[page_id];
+    if (!slot) {
+      slot = std::make_unique<char[]>(PAGESIZE);
+    }
+    std::memcpy(slot.get(), data, PAGESIZE);
+    if (dirty_.size() >= FLUSH_BATCH_PAGES) {
+      if (background_) {
+        wake_.notify_one();
+      } else {
+        WriteBatch(dirty_);
+        dirty_.clear();
+      }
+    }
+  }
+
+  bool WriteBackBuffer::Get(page_id_t page_id, char* out) const {
+    std::lock_guard lock(mutex_);
+    for (const Batch* batch : {&dirty_, &flushing_}) {
+      auto it = batch->find(page_id);
+      if (it != batch->end()) {
+        std::memcpy(out, it->second.get(), PAGESIZE);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void WriteBackBuffer::Flush() {
+    std::unique_lock lock(mutex_);
+    if (stopped_) {
+      return;
+    }
+    if (!background_) {
+      WriteBatch(dirty_);
+      dirty_.clear();
+      return;
+    }
+    flush_requested_ = true;
+    wake_.notify_one();
+    drained_.wait(lock, [&] { return dirty_.empty() && flushing_.empty(); });
+  }
+
+  void WriteBackBuffer::Stop() {
+    {
+      std::lock_guard lock(mutex_);
+      if (stopped_) {
+        return;
+      }
+      if (!background_) {
+        WriteBatch(dirty_);
+        dirty_.clear();
+      }
+      stopped_ = true;
+    }
+    if (background_) {
+      wake_.notify_one();
+      thread_.join();
+    }
+  }
+
+  void WriteBackBuffer::Run() {
+    std::unique_lock lock(mutex_);
+    while (true) {
+      wake_.wait_for(lock, std::chrono::milliseconds(FLUSH_INTERVAL_MS), [&] {
+        return stopped_ || flush_requested_ || dirty_.size() >= FLUSH_BATCH_PAGES;
+      });
+      if (dirty_.empty()) {
+        flush_requested_ = false;
+        drained_.notify_all();
+        if (stopped_) {
+          return;
+        }
+        continue;
+      }
+      flushing_.swap(dirty_);
+      lock.unlock();
+      WriteBatch(flushing_);
+      lock.lock();
+      flushing_.clear();
+      drained_.notify_all();
+    }
+  }
+
+  void WriteBackBuffer::WriteBatch(const Batch& batch) {
+    std::vector<char> run;
+    auto it = batch.begin();
+    while (it != batch.end()) {
+      page_id_t first = it->first;
+      size_t count = 0;
+      auto end = it;
+      while (end != batch.end() && end->first == first + static_cast<page_id_t>(count)) {
+        ++count;
+        ++end;
+      }
+      if (count == 1) {
+        writer_(first, it->second.get(), 1);
+      } else {
+        run.resize(count * PAGESIZE);
+        for (size_t i = 0; it != end; ++it, ++i) {
+          std::memcpy(run.data() + i * PAGESIZE, it->second.get(), PAGESIZE);
+        }
+        writer_(first, run.data(), count);
+      }
+      it = end;
+    }
+  }
+}
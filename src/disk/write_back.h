@@ -0,0 +1,62 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "src/common.h"
+
+namespace RFlowey {
+  /**
+   * @brief collects written pages and writes them out on a background thread.
+   * A batch is sorted by page id and adjacent pages are coalesced into a single write call.
+   * It is flushed once FLUSH_BATCH_PAGES pages are dirty or FLUSH_INTERVAL_MS has passed,
+   * whichever comes first; Put blocks while FLUSH_MAX_PAGES pages are waiting.
+   * Without a spare core the batches are written inline by Put instead, still sorted and coalesced.
+   */
+  class WriteBackBuffer {
+  public:
+    //writes `count` pages starting at page `first`, stored contiguously in `data`
+    using Writer = std::function<void(page_id_t first, const char* data, size_t count)>;
+
+    explicit WriteBackBuffer(Writer writer, bool background = std::thread::hardware_concurrency() > 1);
+    ~WriteBackBuffer();
+    WriteBackBuffer(const WriteBackBuffer&) = delete;
+    WriteBackBuffer& operator=(const WriteBackBuffer&) = delete;
+
+    void Put(page_id_t page_id, const char* data);
+    /**
+     * @brief copy the newest not yet written version of the page into out
+     * @return false if the page has no pending write
+     */
+    bool Get(page_id_t page_id, char* out) const;
+    /**
+     * @brief barrier: returns once every page put before the call has been handed to the writer
+     */
+    void Flush();
+    /**
+     * @brief flush everything and stop the background thread, later puts are written synchronously
+     */
+    void Stop();
+
+  private:
+    using Batch = std::map<page_id_t, std::unique_ptr<char[]>>;
+
+    Writer writer_;
+    bool background_;
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable drained_;
+    Batch dirty_;
+    Batch flushing_;
+    bool flush_requested_ = false;
+    bool stopped_ = false;
+    std::thread thread_;
+
+    void Run();
+    void WriteBatch(const Batch& batch);
+  };
+}
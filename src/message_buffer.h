@@ -0,0 +1,244 @@
+#ifndef MESSAGE_BUFFER_H
+#define MESSAGE_BUFFER_H
+
+#include <map>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "disk/IO_manager.h"
+#include "disk/IO_utils.h"
+#include "src/common.h"
+
+namespace RFlowey {
+
+  enum class MessageOp : char {
+    NONE, INSERT, ERASE
+  };
+
+  /**
+   * @brief a pending insert or erase of one tree entry.
+   * A cancelled message keeps its slot with op NONE.
+   */
+  template<typename Key, typename Value>
+  struct Message {
+    Key key;
+    Value value;
+    MessageOp op = MessageOp::NONE;
+  };
+
+  /**
+   * @brief messages in arrival order; the pages of one buffer are chained by next_page_id_
+   */
+  template<typename Msg>
+  class MessagePage {
+  public:
+#ifndef BPT_SMALL_SIZE
+    static constexpr int SIZEMAX = (PAGESIZE - 64) / sizeof(Msg);
+#else
+    static constexpr int SIZEMAX = 4;
+#endif
+    static_assert(SIZEMAX >= 1);
+
+    page_id_t self_id_ = INVALID_PAGE_ID;
+    page_id_t next_page_id_ = INVALID_PAGE_ID;
+    size_t current_size_ = 0;
+
+    Msg data_[SIZEMAX];
+
+    explicit MessagePage(page_id_t self_id) : self_id_(self_id) {}
+  };
+
+  /**
+   * @brief persistent log of up to CAPACITY messages, stored in a chain of resident pages.
+   * Every push writes one page through; an in-memory index keeps the live messages sorted
+   * by key and, for equal keys, in arrival order, which is the order they must be applied in.
+   */
+  template<typename Msg>
+  class MessageBuffer {
+    using key_type = decltype(Msg::key);
+    using MessagePage_t = MessagePage<Msg>;
+
+    IOManager *manager_ = nullptr;
+    std::vector<page_id_t> pages_;
+    std::vector<Msg> messages_;
+    std::multimap<key_type, size_t> index_;
+
+    PageRef<MessagePage_t> page_ref(size_t page) {
+      manager_->Pin(pages_[page]);
+      return PagePtr<MessagePage_t>{pages_[page], manager_}.get_ref();
+    }
+
+  public:
+    static constexpr size_t CAPACITY = MESSAGE_BUFFER_PAGES * MessagePage_t::SIZEMAX;
+    using const_iterator = typename std::multimap<key_type, size_t>::const_iterator;
+
+    /**
+     * @param head first page of an existing buffer, INVALID_PAGE_ID if there is none yet
+     */
+    void open(IOManager *manager, page_id_t head) {
+      manager_ = manager;
+      for (page_id_t id = head; id != INVALID_PAGE_ID;) {
+        pages_.push_back(id);
+        auto page = page_ref(pages_.size() - 1);
+        const MessagePage_t &view = *std::as_const(page);
+        for (size_t i = 0; i < view.current_size_; ++i) {
+          push_index(view.data_[i]);
+        }
+        id = view.next_page_id_;
+      }
+    }
+
+    [[nodiscard]] page_id_t head() const {
+      return pages_.empty() ? INVALID_PAGE_ID : pages_.front();
+    }
+    [[nodiscard]] bool empty() const { return index_.empty(); }
+    [[nodiscard]] bool full() const { return messages_.size() >= CAPACITY; }
+    [[nodiscard]] size_t size() const { return index_.size(); }
+
+    void push(const Msg &msg) {
+      size_t page = messages_.size() / MessagePage_t::SIZEMAX;
+      if (page == pages_.size()) {
+        auto ptr = allocate<MessagePage_t>(manager_);
+        ptr.make_ref(ptr.page_id());
+        if (!pages_.empty()) {
+          page_ref(pages_.size() - 1)->next_page_id_ = ptr.page_id();
+        }
+        pages_.push_back(ptr.page_id());
+      }
+      auto ref = page_ref(page);
+      ref->data_[ref->current_size_++] = msg;
+      push_index(msg);
+    }
+
+    /**
+     * @brief turn the message at it into a no-op
+     */
+    void cancel(const_iterator it) {
+      size_t slot = it->second;
+      messages_[slot].op = MessageOp::NONE;
+      page_ref(slot / MessagePage_t::SIZEMAX)->data_[slot % MessagePage_t::SIZEMAX].op = MessageOp::NONE;
+      index_.erase(it);
+    }
+
+    /**
+     * @return the live messages with lower <= key < upper, sorted for application;
+     * an upper that is not above lower (a wrapped bound) leaves the range open
+     */
+    [[nodiscard]] std::pair<const_iterator, const_iterator> range(const key_type &lower, const key_type &upper) const {
+      if (upper <= lower) {
+        return {index_.lower_bound(lower), index_.end()};
+      }
+      return {index_.lower_bound(lower), index_.lower_bound(upper)};
+    }
+
+    /**
+     * @return the live messages on exactly this key, in arrival order
+     */
+    [[nodiscard]] std::pair<const_iterator, const_iterator> equal_range(const key_type &key) const {
+      return index_.equal_range(key);
+    }
+
+    [[nodiscard]] const Msg &operator[](const_iterator it) const {
+      return messages_[it->second];
+    }
+
+    /**
+     * @return every live message, sorted for application
+     */
+    [[nodiscard]] std::vector<Msg> sorted() const {
+      std::vector<Msg> result;
+      result.reserve(index_.size());
+      for (const auto &[key, slot] : index_) {
+        result.push_back(messages_[slot]);
+      }
+      return result;
+    }
+
+    /**
+     * @brief drop every message, the pages are kept for reuse
+     */
+    void clear() {
+      //a buffer of messages that cannot be stored in pages is never opened and has none
+      if constexpr (std::is_trivially_copyable_v<Msg>) {
+        for (size_t i = 0; i < pages_.size(); ++i) {
+          page_ref(i)->current_size_ = 0;
+        }
+      }
+      messages_.clear();
+      index_.clear();
+    }
+
+  private:
+    void push_index(const Msg &msg) {
+      messages_.push_back(msg);
+      if (msg.op != MessageOp::NONE) {
+        //equal keys are inserted at the end of their range, keeping arrival order
+        index_.emplace(msg.key, messages_.size() - 1);
+      }
+    }
+  };
+
+  /**
+   * @brief in-memory messages sorted like MessageBuffer, with the same interface, holding up to
+   * MEMTABLE_BUDGET bytes. Nothing is persisted: the owner drains it before the file is closed.
+   */
+  template<typename Msg>
+  class MemTable {
+    using key_type = decltype(Msg::key);
+
+    std::multimap<key_type, Msg> messages_;
+
+  public:
+#ifndef BPT_SMALL_SIZE
+    //a tree node holds the entry plus a color and three links
+    static constexpr size_t CAPACITY = MEMTABLE_BUDGET / (sizeof(std::pair<const key_type, Msg>) + 4 * sizeof(void*));
+#else
+    static constexpr size_t CAPACITY = 64;
+#endif
+    using const_iterator = typename std::multimap<key_type, Msg>::const_iterator;
+
+    [[nodiscard]] bool empty() const { return messages_.empty(); }
+    [[nodiscard]] bool full() const { return messages_.size() >= CAPACITY; }
+    [[nodiscard]] size_t size() const { return messages_.size(); }
+
+    void push(const Msg &msg) {
+      //equal keys are inserted at the end of their range, keeping arrival order
+      messages_.emplace(msg.key, msg);
+    }
+
+    void cancel(const_iterator it) {
+      messages_.erase(it);
+    }
+
+    [[nodiscard]] std::pair<const_iterator, const_iterator> range(const key_type &lower, const key_type &upper) const {
+      if (upper <= lower) {
+        return {messages_.lower_bound(lower), messages_.end()};
+      }
+      return {messages_.lower_bound(lower), messages_.lower_bound(upper)};
+    }
+
+    [[nodiscard]] std::pair<const_iterator, const_iterator> equal_range(const key_type &key) const {
+      return messages_.equal_range(key);
+    }
+
+    [[nodiscard]] const Msg &operator[](const_iterator it) const {
+      return it->second;
+    }
+
+    [[nodiscard]] std::vector<Msg> sorted() const {
+      std::vector<Msg> result;
+      result.reserve(messages_.size());
+      for (const auto &[key, msg] : messages_) {
+        result.push_back(msg);
+      }
+      return result;
+    }
+
+    void clear() {
+      messages_.clear();
+    }
+  };
+}
+
+#endif //MESSAGE_BUFFER_H
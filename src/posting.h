@@ -0,0 +1,422 @@
+#ifndef POSTING_H
+#define POSTING_H
+
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "BPT.h"
+
+namespace RFlowey {
+
+  /**
+   * @brief a page of entries sorted by Hash.
+   * A posting list is a chain of directory pages, whose entries are the lower fence and id of
+   * each data page of the list, and data pages holding the bare values: their hashes are sorted,
+   * so they are not stored but recomputed while searching. The fences of the first directory
+   * start at 0, and a value goes to the last data page whose fence is not above its hash.
+   */
+  template<typename T, typename Hash>
+  class PostingPage {
+  public:
+    using value_type = T;
+#ifndef BPT_SMALL_SIZE
+    static constexpr int SIZEMAX = (PAGESIZE - 64) / sizeof(value_type);
+#else
+    static constexpr int SIZEMAX = 6;
+#endif
+    static_assert(SIZEMAX >= 2);
+
+    page_id_t self_id_ = INVALID_PAGE_ID;
+    //next directory page, unused by data pages
+    page_id_t next_page_id_ = INVALID_PAGE_ID;
+    size_t current_size_ = 0;
+
+    value_type data_[SIZEMAX];
+
+    explicit PostingPage(page_id_t self_id) : self_id_(self_id) {}
+
+    /**
+     * @return the first index whose hash is not below hash
+     */
+    [[nodiscard]] index_type lower_bound(hash_t hash) const {
+      index_type l = 0, r = current_size_;
+      while (l < r) {
+        index_type mid = l + (r - l) / 2;
+        if (Hash{}(data_[mid]) < hash) {
+          l = mid + 1;
+        } else {
+          r = mid;
+        }
+      }
+      return l;
+    }
+
+    /**
+     * @return the first index whose hash is above hash
+     */
+    [[nodiscard]] index_type upper_bound(hash_t hash) const {
+      index_type l = 0, r = current_size_;
+      while (l < r) {
+        index_type mid = l + (r - l) / 2;
+        if (Hash{}(data_[mid]) <= hash) {
+          l = mid + 1;
+        } else {
+          r = mid;
+        }
+      }
+      return l;
+    }
+
+    [[nodiscard]] bool full() const {
+      return current_size_ >= SIZEMAX;
+    }
+
+    void insert_at(index_type pos, const value_type &value) {
+#ifdef BPT_TEST
+      if (full()) {
+        throw std::overflow_error("PostingPage::insert_at: page is full");
+      }
+#endif
+      std::memmove(data_ + pos + 1, data_ + pos, sizeof(value_type) * (current_size_ - pos));
+      data_[pos] = value;
+      current_size_++;
+    }
+
+    void erase(index_type pos) {
+      std::memmove(data_ + pos, data_ + pos + 1, sizeof(value_type) * (current_size_ - pos - 1));
+      current_size_--;
+    }
+
+    /**
+     * @brief move the entries from mid on to the empty page right
+     */
+    void split_to(PostingPage &right, size_t mid) {
+      std::memcpy(right.data_, data_ + mid, (current_size_ - mid) * sizeof(value_type));
+      right.current_size_ = current_size_ - mid;
+      current_size_ = mid;
+    }
+  };
+
+  /**
+   * @brief a tree entry of PostingBPT: one value of the key, or the head of its posting list
+   */
+  template<typename Value>
+  struct PostingEntry {
+    page_id_t head = INVALID_PAGE_ID;
+    Value value{};
+
+    [[nodiscard]] bool is_list() const {
+      return head != INVALID_PAGE_ID;
+    }
+  };
+
+  /**
+   * @brief a multimap for keys with many values, with the interface of BPT.
+   * A key starts with one tree entry per value, like in BPT. Once it has POSTING_INLINE_MAX
+   * values they move to a posting list: the tree keeps a single entry holding the key and the
+   * head of the list, and the values live, sorted by hash, in dense pages of the same file.
+   * A hot key is then stored once and read from a few pages.
+   */
+  template<typename Key, typename Value, typename KeyHash = std::hash<Key>, typename ValueHash = std::hash<Value>>
+  class PostingBPT {
+    using Entry = PostingEntry<Value>;
+    using Fence = pair<hash_t, page_id_t>;
+
+    //the list entry sorts after the inline values of its key, a key has at most one
+    static constexpr hash_t LIST_HASH = std::numeric_limits<hash_t>::max();
+
+    //LIST_HASH is reserved for the list entry: a value hashing to it counts as LIST_HASH - 1,
+    //inline and in the list alike
+    struct CappedHash {
+      hash_t operator()(const Value &value) const {
+        return std::min(ValueHash{}(value), LIST_HASH - 1);
+      }
+    };
+    struct FenceHash {
+      hash_t operator()(const Fence &fence) const {
+        return fence.first;
+      }
+    };
+    using DataPage = PostingPage<Value, CappedHash>;
+    using DirectoryPage = PostingPage<Fence, FenceHash>;
+
+    struct EntryHash {
+      CappedHash value_hash{};
+      hash_t operator()(const Entry &entry) const {
+        return entry.is_list() ? LIST_HASH : value_hash(entry.value);
+      }
+    };
+
+    using Tree = BPT<Key, Entry, KeyHash, EntryHash>;
+    using WriteAction = typename Tree::WriteAction;
+
+    Tree tree_;
+    CappedHash value_hash{};
+
+    template<typename Page>
+    PageRef<Page> page_ref(page_id_t page_id) {
+      return PagePtr<Page>{page_id, tree_.io_manager()}.get_ref();
+    }
+
+    template<typename Page>
+    PageRef<Page> new_page() {
+      auto ptr = allocate<Page>(tree_.io_manager());
+      return ptr.make_ref(ptr.page_id());
+    }
+
+    /**
+     * @return the directory page of the list covering hash
+     */
+    PageRef<DirectoryPage> route(page_id_t head, hash_t hash) {
+      auto dir = page_ref<DirectoryPage>(head);
+      while (std::as_const(dir)->next_page_id_ != INVALID_PAGE_ID) {
+        auto next = page_ref<DirectoryPage>(std::as_const(dir)->next_page_id_);
+        if (hash < std::as_const(next)->data_[0].first) {
+          break;
+        }
+        dir = std::move(next);
+      }
+      return dir;
+    }
+
+    /**
+     * @brief move the inline values of key, plus one new value, to a new posting list
+     */
+    void make_list(const Key &key, const sjtu::vector<Entry> &entries, const Value &value) {
+      std::vector<Value> values;
+      values.reserve(entries.size() + 1);
+      for (size_t i = 0; i < entries.size(); ++i) {
+        values.push_back(entries[i].value);
+      }
+      values.push_back(value);
+      std::stable_sort(values.begin(), values.end(), [this](const Value &a, const Value &b) {
+        return value_hash(a) < value_hash(b);
+      });
+      //pages are filled halfway, leaving room for inserts
+      std::vector<Fence> pages;
+      constexpr size_t data_fill = DataPage::SIZEMAX / 2 + 1;
+      for (size_t i = 0; i < values.size(); i += data_fill) {
+        auto page = new_page<DataPage>();
+        page->current_size_ = std::min(data_fill, values.size() - i);
+        std::memcpy(page->data_, values.data() + i, page->current_size_ * sizeof(Value));
+        pages.push_back({pages.empty() ? 0 : value_hash(values[i]), page->self_id_});
+      }
+      constexpr size_t directory_fill = DirectoryPage::SIZEMAX / 2 + 1;
+      page_id_t head = INVALID_PAGE_ID;
+      PageRef<DirectoryPage> prev;
+      for (size_t i = 0; i < pages.size(); i += directory_fill) {
+        auto dir = new_page<DirectoryPage>();
+        dir->current_size_ = std::min(directory_fill, pages.size() - i);
+        std::memcpy(dir->data_, pages.data() + i, dir->current_size_ * sizeof(pages[0]));
+        if (head == INVALID_PAGE_ID) {
+          head = dir->self_id_;
+        } else {
+          prev->next_page_id_ = dir->self_id_;
+        }
+        prev = std::move(dir);
+      }
+      for (size_t i = 0; i < entries.size(); ++i) {
+        tree_.erase(key, entries[i]);
+      }
+      tree_.insert(key, Entry{head, {}});
+    }
+
+    void list_insert(page_id_t head, const Value &value) {
+      hash_t hash = value_hash(value);
+      auto dir = route(head, hash);
+      index_type slot = std::as_const(dir)->upper_bound(hash) - 1;
+      auto data = page_ref<DataPage>(std::as_const(dir)->data_[slot].second);
+      index_type pos = std::as_const(data)->upper_bound(hash);
+      if (!std::as_const(data)->full()) {
+        data->insert_at(pos, value);
+        return;
+      }
+      //split the full data page, the upper half moves to a new page behind it
+      auto right = new_page<DataPage>();
+      size_t mid = data->current_size_ / 2;
+      data->split_to(*right, mid);
+      if (pos <= mid) {
+        data->insert_at(pos, value);
+      } else {
+        right->insert_at(pos - mid, value);
+      }
+      Fence fence = {value_hash(std::as_const(right)->data_[0]), right->self_id_};
+      if (!std::as_const(dir)->full()) {
+        dir->insert_at(slot + 1, fence);
+        return;
+      }
+      auto next_dir = new_page<DirectoryPage>();
+      size_t dir_mid = dir->current_size_ / 2;
+      dir->split_to(*next_dir, dir_mid);
+      next_dir->next_page_id_ = dir->next_page_id_;
+      dir->next_page_id_ = next_dir->self_id_;
+      if (slot + 1 <= dir_mid) {
+        dir->insert_at(slot + 1, fence);
+      } else {
+        next_dir->insert_at(slot + 1 - dir_mid, fence);
+      }
+    }
+
+    /**
+     * @return whether the list had a value of this hash, and whether the list is now empty
+     */
+    std::pair<bool, bool> list_erase(page_id_t head, hash_t hash) {
+      //a split can leave values of one hash on both sides of a fence, so the search starts at the
+      //last data page fenced below hash and goes on through the pages fenced at hash
+      page_id_t prev_id = INVALID_PAGE_ID;
+      auto dir = page_ref<DirectoryPage>(head);
+      while (std::as_const(dir)->next_page_id_ != INVALID_PAGE_ID) {
+        auto next = page_ref<DirectoryPage>(std::as_const(dir)->next_page_id_);
+        if (hash <= std::as_const(next)->data_[0].first) {
+          break;
+        }
+        prev_id = std::as_const(dir)->self_id_;
+        dir = std::move(next);
+      }
+      index_type slot = std::max<index_type>(std::as_const(dir)->lower_bound(hash), 1) - 1;
+      while (true) {
+        auto data = page_ref<DataPage>(std::as_const(dir)->data_[slot].second);
+        index_type pos = std::as_const(data)->lower_bound(hash);
+        if (pos < std::as_const(data)->current_size_ && value_hash(std::as_const(data)->data_[pos]) == hash) {
+          data->erase(pos);
+          if (std::as_const(data)->current_size_ > 0) {
+            return {true, false};
+          }
+          break;
+        }
+        if (slot + 1 < std::as_const(dir)->current_size_) {
+          ++slot;
+        } else if (std::as_const(dir)->next_page_id_ != INVALID_PAGE_ID) {
+          auto next = page_ref<DirectoryPage>(std::as_const(dir)->next_page_id_);
+          prev_id = std::as_const(dir)->self_id_;
+          dir = std::move(next);
+          slot = 0;
+        } else {
+          return {false, false};
+        }
+        if (std::as_const(dir)->data_[slot].first > hash) {
+          return {false, false};
+        }
+      }
+      //the data page at slot is now empty and goes, and so does its directory if it was alone there
+      const DirectoryPage &view = *std::as_const(dir);
+      tree_.io_manager()->DeletePage(view.data_[slot].second);
+      if (view.current_size_ > 1) {
+        dir->erase(slot);
+        if (view.self_id_ == head) {
+          dir->data_[0].first = 0;
+        }
+        return {true, false};
+      }
+      if (view.self_id_ != head) {
+        auto prev = page_ref<DirectoryPage>(prev_id);
+        prev->next_page_id_ = view.next_page_id_;
+        tree_.io_manager()->DeletePage(view.self_id_);
+        return {true, false};
+      }
+      if (view.next_page_id_ == INVALID_PAGE_ID) {
+        tree_.io_manager()->DeletePage(head);
+        return {true, true};
+      }
+      //the head keeps its id for the tree entry, the second directory moves into it
+      page_id_t next_id = view.next_page_id_;
+      {
+        auto next = page_ref<DirectoryPage>(next_id);
+        const DirectoryPage &next_view = *std::as_const(next);
+        std::memcpy(dir->data_, next_view.data_, next_view.current_size_ * sizeof(Fence));
+        dir->current_size_ = next_view.current_size_;
+        dir->next_page_id_ = next_view.next_page_id_;
+        dir->data_[0].first = 0;
+      }
+      tree_.io_manager()->DeletePage(next_id);
+      return {true, false};
+    }
+
+  public:
+    explicit PostingBPT(const std::string &file_name) : tree_(file_name) {}
+
+    /**
+     * @return a vector of the values correspond to the key;(sorted by the hash of value)
+     */
+    sjtu::vector<Value> find(const Key &key) {
+      sjtu::vector<Value> result;
+      auto entries = tree_.find(key);
+      for (size_t i = 0; i < entries.size(); ++i) {
+        if (!entries[i].is_list()) {
+          result.push_back(entries[i].value);
+          continue;
+        }
+        for (page_id_t id = entries[i].head; id != INVALID_PAGE_ID;) {
+          auto dir = page_ref<DirectoryPage>(id);
+          const DirectoryPage &view = *std::as_const(dir);
+          for (size_t j = 0; j < view.current_size_; ++j) {
+            auto data = page_ref<DataPage>(view.data_[j].second);
+            const DataPage &page = *std::as_const(data);
+            for (size_t k = 0; k < page.current_size_; ++k) {
+              result.push_back(page.data_[k]);
+            }
+          }
+          id = view.next_page_id_;
+        }
+      }
+      return result;
+    }
+
+    void insert(const Key &key, const Value &value) {
+      //the list entry sorts last, so the last value of key tells a list from inline values
+      page_id_t head = INVALID_PAGE_ID;
+      bool full = false;
+      tree_.modify_key(key, Entry{INVALID_PAGE_ID, value}, Tree::OperationType::INSERT,
+        [&](const Entry *last, size_t count) {
+          if (last != nullptr && last->is_list()) {
+            head = last->head;
+            return WriteAction::KEEP;
+          }
+          full = count + 1 >= POSTING_INLINE_MAX;
+          return full ? WriteAction::KEEP : WriteAction::PUT;
+        });
+      if (head != INVALID_PAGE_ID) {
+        list_insert(head, value);
+      } else if (full) {
+        //once per key, reads its inline values back
+        make_list(key, tree_.find(key), value);
+      }
+    }
+
+    /**
+     * @brief erase one value whose hash equals the hash of value
+     * @return false if the key has no such value
+     */
+    bool erase(const Key &key, const Value &value) {
+      page_id_t head = INVALID_PAGE_ID;
+      WriteAction action = tree_.modify_key(key, Entry{INVALID_PAGE_ID, value}, Tree::OperationType::DELETE,
+        [&head](const Entry *last, size_t) {
+          if (last != nullptr && last->is_list()) {
+            head = last->head;
+            return WriteAction::KEEP;
+          }
+          return WriteAction::ERASE;
+        });
+      if (head == INVALID_PAGE_ID) {
+        return action == WriteAction::ERASE;
+      }
+      auto [erased, emptied] = list_erase(head, value_hash(value));
+      if (emptied) {
+        tree_.erase(key, Entry{head, {}});
+      }
+      return erased;
+    }
+
+    /**
+     * @brief barrier: the tree and the posting lists as of now are on disk when this returns
+     */
+    void flush() {
+      tree_.flush();
+    }
+  };
+}
+
+#endif //POSTING_H
@@ -0,0 +1,127 @@
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <unordered_map>
+#include <vector>
+
+#include "src/common.h"
+
+namespace RFlowey {
+
+  /**
+   * @brief the values of up to CAPACITY keys, found by key hash and evicted by CLOCK.
+   * A slot is only trusted for the key it was filled for; any write on a key hash drops its slot.
+   */
+  template<typename Key, typename Value>
+  class ResultCache {
+    struct Slot {
+      hash_t hash = 0;
+      Key key{};
+      std::vector<Value> values;
+      bool used = false;
+      //set by every hit, cleared by the hand as it passes
+      bool referenced = false;
+    };
+
+    std::vector<Slot> slots_;
+    std::unordered_map<hash_t, size_t> index_;
+    size_t hand_ = 0;
+
+  public:
+#ifndef BPT_SMALL_SIZE
+    static constexpr size_t CAPACITY = RESULT_CACHE_ENTRIES;
+#else
+    static constexpr size_t CAPACITY = 16;
+#endif
+
+    ResultCache() : slots_(CAPACITY) {}
+
+    /**
+     * @return the cached values of key, nullptr on a miss
+     */
+    const std::vector<Value> *find(hash_t hash, const Key &key) {
+      auto it = index_.find(hash);
+      if (it == index_.end()) {
+        return nullptr;
+      }
+      Slot &slot = slots_[it->second];
+      if (!(slot.key == key)) {
+        return nullptr;
+      }
+      slot.referenced = true;
+      return &slot.values;
+    }
+
+    /**
+     * @brief cache the values of key, unless there are more than RESULT_CACHE_MAX_VALUES of them.
+     * The values are taken by swapping: values is left with the storage of the replaced slot.
+     * @return the cached values, nullptr if they were not cached
+     */
+    const std::vector<Value> *put(hash_t hash, const Key &key, std::vector<Value> &values) {
+      if (values.size() > RESULT_CACHE_MAX_VALUES) {
+        return nullptr;
+      }
+      auto it = index_.find(hash);
+      size_t index;
+      if (it != index_.end()) {
+        index = it->second;
+      } else {
+        while (slots_[hand_].referenced) {
+          slots_[hand_].referenced = false;
+          hand_ = (hand_ + 1) % CAPACITY;
+        }
+        index = hand_;
+        hand_ = (hand_ + 1) % CAPACITY;
+        if (slots_[index].used) {
+          index_.erase(slots_[index].hash);
+        }
+        index_.emplace(hash, index);
+      }
+      Slot &slot = slots_[index];
+      slot.hash = hash;
+      slot.key = key;
+      slot.values.swap(values);
+      slot.used = true;
+      slot.referenced = false;
+      return &slot.values;
+    }
+
+    /**
+     * @brief forget the values of every key of this hash
+     */
+    void invalidate(hash_t hash) {
+      auto it = index_.find(hash);
+      if (it == index_.end()) {
+        return;
+      }
+      Slot &slot = slots_[it->second];
+      slot.used = false;
+      slot.referenced = false;
+      index_.erase(it);
+    }
+
+    /**
+     * @brief forget the values of every key whose hash is in [lower, upper), none if upper <= lower
+     */
+    void invalidate_range(hash_t lower, hash_t upper) {
+      for (Slot &slot : slots_) {
+        if (slot.used && slot.hash >= lower && slot.hash < upper) {
+          invalidate(slot.hash);
+        }
+      }
+    }
+
+    /**
+     * @brief forget the values of every key whose hash is lower or above
+     */
+    void invalidate_from(hash_t lower) {
+      for (Slot &slot : slots_) {
+        if (slot.used && slot.hash >= lower) {
+          invalidate(slot.hash);
+        }
+      }
+    }
+  };
+}
+
+#endif //RESULT_CACHE_H
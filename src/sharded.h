@@ -0,0 +1,342 @@
+#ifndef SHARDED_H
+#define SHARDED_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "BPT.h"
+
+namespace RFlowey {
+
+  /**
+   * @brief a tree hash-partitioned into independent shards.
+   * Shard i is a BPT of its own in file_name.i, with its own IO manager, and a key lives in the
+   * shard picked by the high bits of its mixed key hash, so every value of a key is in one shard
+   * and a split or merge never reaches past it. Single operations lock their shard; batches are
+   * grouped by shard and handed to the batched calls of the shards, which run in parallel on a
+   * worker thread per shard that is started once, with the tree.
+   * The shard count is part of the layout: every shard records it on its aux page, and reopening
+   * a set of files with another count throws.
+   */
+  template<typename Key, typename Value, typename KeyHash = std::hash<Key>, typename ValueHash = std::hash<Value>>
+  class ShardedBPT {
+    using Tree = BPT<Key, Value, KeyHash, ValueHash>;
+
+    /**
+     * @brief a tree and, with a spare core, a worker of its own that runs the batches handed to it
+     * one at a time; the worker lives as long as the shard
+     */
+    struct Shard {
+      Tree tree;
+      std::mutex mutex;
+
+      std::mutex job_mutex;
+      std::condition_variable wake;
+      std::condition_variable done;
+      std::function<void()> job;
+      std::exception_ptr error;
+      bool stopped = false;
+      std::thread worker;
+
+      Shard(const std::string &file_name, bool background) : tree(file_name) {
+        if (background) {
+          worker = std::thread([this] { run(); });
+        }
+      }
+
+      ~Shard() {
+        if (!worker.joinable()) {
+          return;
+        }
+        {
+          std::lock_guard lock(job_mutex);
+          stopped = true;
+        }
+        wake.notify_one();
+        worker.join();
+      }
+
+      void run() {
+        std::unique_lock lock(job_mutex);
+        while (true) {
+          wake.wait(lock, [this] { return stopped || job; });
+          if (!job) {
+            return;
+          }
+          lock.unlock();
+          try {
+            job();
+          } catch (...) {
+            error = std::current_exception();
+          }
+          lock.lock();
+          job = nullptr;
+          done.notify_all();
+        }
+      }
+
+      /**
+       * @brief hand f to the worker, or run it here without one
+       */
+      void post(std::function<void()> f) {
+        if (!worker.joinable()) {
+          f();
+          return;
+        }
+        std::lock_guard lock(job_mutex);
+        job = std::move(f);
+        wake.notify_one();
+      }
+
+      /**
+       * @brief wait until the job posted last has run
+       * @return what it threw, if anything
+       */
+      std::exception_ptr wait() {
+        std::unique_lock lock(job_mutex);
+        done.wait(lock, [this] { return !job; });
+        return std::exchange(error, nullptr);
+      }
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    KeyHash key_hash{};
+
+    //a value list of find_many's result, filled in place by the find_many of a shard
+    struct ResultSlot {
+      sjtu::vector<Value> *values;
+
+      void clear() {
+        values->clear();
+      }
+      void push_back(const Value &value) {
+        values->push_back(value);
+      }
+      [[nodiscard]] size_t size() const {
+        return values->size();
+      }
+    };
+
+    //what a shard keeps on its aux page
+    struct ShardInfo {
+      size_t shard_count;
+    };
+
+    /**
+     * @brief record the shard count in a shard that has none yet, or check it against the recorded one
+     * @throw std::runtime_error if the shard was written with another count
+     */
+    static void check_shard_count(Tree &tree, const std::string &file_name, size_t shard_count) {
+      if (tree.aux_page() == INVALID_PAGE_ID) {
+        PagePtr<ShardInfo> ptr{tree.io_manager()->NewPage(), tree.io_manager()};
+        ptr.make_ref(ShardInfo{shard_count});
+        tree.set_aux_page(ptr.page_id());
+        return;
+      }
+      auto info = PagePtr<ShardInfo>{tree.aux_page(), tree.io_manager()}.get_ref();
+      size_t saved = std::as_const(info)->shard_count;
+      if (saved != shard_count) {
+        throw std::runtime_error("ShardedBPT: " + file_name + " belongs to " + std::to_string(saved) +
+                                 " shards, not " + std::to_string(shard_count));
+      }
+    }
+
+    [[nodiscard]] size_t shard_of(hash_t hash) const {
+      //the test and integer hashers leave the high bits constant, mix before taking them
+      return static_cast<size_t>((static_cast<unsigned __int128>(mix(hash)) * shards_.size()) >> 64);
+    }
+
+    /**
+     * @brief group the indices of keys by shard, in the order of keys, and call f(tree, group) for
+     * every shard with work, the shards in parallel: each on its worker, the last one on the
+     * calling thread
+     */
+    template<typename F>
+    void fan_out(const std::vector<Key> &keys, F &&f) {
+      std::vector<std::vector<size_t>> groups(shards_.size());
+      for (size_t i = 0; i < keys.size(); ++i) {
+        groups[shard_of(key_hash(keys[i]))].push_back(i);
+      }
+      auto work = [&](size_t s) {
+        std::lock_guard lock(shards_[s]->mutex);
+        f(shards_[s]->tree, groups[s]);
+      };
+      std::vector<size_t> posted;
+      size_t last = shards_.size();
+      for (size_t s = 0; s < shards_.size(); ++s) {
+        if (groups[s].empty()) {
+          continue;
+        }
+        if (last != shards_.size()) {
+          shards_[last]->post([&work, last] { work(last); });
+          posted.push_back(last);
+        }
+        last = s;
+      }
+      //the posted jobs use the groups, so all of them are waited for before anything is rethrown
+      std::exception_ptr error;
+      if (last != shards_.size()) {
+        try {
+          work(last);
+        } catch (...) {
+          error = std::current_exception();
+        }
+      }
+      for (size_t s : posted) {
+        std::exception_ptr failed = shards_[s]->wait();
+        if (!error) {
+          error = failed;
+        }
+      }
+      if (error) {
+        std::rethrow_exception(error);
+      }
+    }
+
+    Shard &shard(const Key &key) {
+      return *shards_[shard_of(key_hash(key))];
+    }
+
+  public:
+    ShardedBPT(const std::string &file_name, size_t shard_count,
+               bool background = std::thread::hardware_concurrency() > 1) {
+      shard_count = std::max<size_t>(shard_count, 1);
+      for (size_t i = 0; i < shard_count; ++i) {
+        std::string shard_file = file_name + "." + std::to_string(i);
+        shards_.push_back(std::make_unique<Shard>(shard_file, background));
+        //shard 0 is checked before any other file is created
+        check_shard_count(shards_.back()->tree, shard_file, shard_count);
+      }
+    }
+
+    [[nodiscard]] size_t shard_count() const {
+      return shards_.size();
+    }
+
+    /**
+     * @return a vector of the values correspond to the key;(sorted by the hash of value)
+     */
+    sjtu::vector<Value> find(const Key &key) {
+      Shard &s = shard(key);
+      std::lock_guard lock(s.mutex);
+      return s.tree.find(key);
+    }
+
+    bool contains(const Key &key) {
+      Shard &s = shard(key);
+      std::lock_guard lock(s.mutex);
+      return s.tree.contains(key);
+    }
+
+    size_t count(const Key &key) {
+      Shard &s = shard(key);
+      std::lock_guard lock(s.mutex);
+      return s.tree.count(key);
+    }
+
+    void insert(const Key &key, const Value &value) {
+      Shard &s = shard(key);
+      std::lock_guard lock(s.mutex);
+      s.tree.insert(key, value);
+    }
+
+    bool erase(const Key &key, const Value &value) {
+      Shard &s = shard(key);
+      std::lock_guard lock(s.mutex);
+      return s.tree.erase(key, value);
+    }
+
+    /**
+     * @return the values of every key, in the order of keys
+     */
+    std::vector<sjtu::vector<Value>> find_many(const std::vector<Key> &keys) {
+      std::vector<sjtu::vector<Value>> result(keys.size());
+      fan_out(keys, [&](Tree &tree, const std::vector<size_t> &group) {
+        std::vector<Key> shard_keys;
+        std::vector<ResultSlot> slots;
+        shard_keys.reserve(group.size());
+        slots.reserve(group.size());
+        for (size_t i : group) {
+          shard_keys.push_back(keys[i]);
+          slots.push_back({&result[i]});
+        }
+        tree.find_many(shard_keys, slots);
+      });
+      return result;
+    }
+
+    /**
+     * @brief insert (keys[i], values[i]) for every i, each shard its pairs in one insert_many
+     */
+    void insert_many(const std::vector<Key> &keys, const std::vector<Value> &values) {
+      fan_out(keys, [&](Tree &tree, const std::vector<size_t> &group) {
+        std::vector<Key> shard_keys;
+        std::vector<Value> shard_values;
+        shard_keys.reserve(group.size());
+        shard_values.reserve(group.size());
+        for (size_t i : group) {
+          shard_keys.push_back(keys[i]);
+          shard_values.push_back(values[i]);
+        }
+        tree.insert_many(shard_keys, shard_values);
+      });
+    }
+
+    /**
+     * @brief erase (keys[i], values[i]) for every i, each shard its pairs in the order of their key
+     * hashes so that the descents follow each other through the tree
+     * @return the number of pairs that were present
+     */
+    size_t erase_many(const std::vector<Key> &keys, const std::vector<Value> &values) {
+      std::vector<char> erased(keys.size(), 0);
+      fan_out(keys, [&](Tree &tree, const std::vector<size_t> &group) {
+        std::vector<std::pair<hash_t, size_t>> order;
+        order.reserve(group.size());
+        for (size_t i : group) {
+          order.emplace_back(key_hash(keys[i]), i);
+        }
+        std::sort(order.begin(), order.end());
+        for (const auto &[hash, i] : order) {
+          erased[i] = tree.erase(keys[i], values[i]);
+        }
+      });
+      return std::count(erased.begin(), erased.end(), 1);
+    }
+
+    /**
+     * @brief barrier: every shard as of now is on disk when this returns
+     */
+    void flush() {
+      for (auto &s : shards_) {
+        std::lock_guard lock(s->mutex);
+        s->tree.flush();
+      }
+    }
+
+#ifdef BPT_TEST
+    /**
+     * @return the smallest of check_structure() over the shards
+     */
+    size_t check_structure() {
+      size_t min_size = std::numeric_limits<size_t>::max();
+      for (auto &s : shards_) {
+        std::lock_guard lock(s->mutex);
+        min_size = std::min(min_size, s->tree.check_structure());
+      }
+      return min_size;
+    }
+#endif
+  };
+}
+
+#endif //SHARDED_H
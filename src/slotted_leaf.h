@@ -0,0 +1,475 @@
+#ifndef SLOTTED_LEAF_H
+#define SLOTTED_LEAF_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "disk/IO_manager.h"
+#include "disk/IO_utils.h"
+#include "src/utils/utils.h"
+#include "src/common.h"
+#include "Node.h"
+
+namespace RFlowey {
+
+  /**
+   * @brief how a slotted leaf stores a key or a value: size(value) bytes, at most MAX_SIZE,
+   * written by write and read back by read. The default stores the object as it is.
+   */
+  template<typename T>
+  struct Codec {
+    static_assert(std::is_trivially_copyable_v<T>, "Codec: a type that is not trivially copyable needs a Codec of its own");
+    static constexpr size_t MAX_SIZE = sizeof(T);
+
+    static size_t size(const T &) {
+      return sizeof(T);
+    }
+    static void write(char *out, const T &value) {
+      std::memcpy(out, &value, sizeof(T));
+    }
+    static T read(const char *in, size_t) {
+      T value;
+      std::memcpy(&value, in, sizeof(T));
+      return value;
+    }
+  };
+
+  //the characters before the zero padding
+  template<int N>
+  struct Codec<string<N>> {
+    static constexpr size_t MAX_SIZE = N;
+
+    static size_t size(const string<N> &value) {
+      return value.length();
+    }
+    static void write(char *out, const string<N> &value) {
+      std::memcpy(out, value.data(), value.length());
+    }
+    static string<N> read(const char *in, size_t size) {
+      return string<N>(in, size);
+    }
+  };
+
+  //the characters; how long a key may be is up to the leaf, see SlottedLeaf::RECORD_MAX
+  template<>
+  struct Codec<std::string> {
+    static constexpr size_t MAX_SIZE = std::numeric_limits<uint16_t>::max();
+
+    static size_t size(const std::string &value) {
+      return value.size();
+    }
+    static void write(char *out, const std::string &value) {
+      std::memcpy(out, value.data(), value.size());
+    }
+    static std::string read(const char *in, size_t size) {
+      return std::string(in, size);
+    }
+  };
+
+  //the size of first in two bytes, then first and second
+  template<typename T1, typename T2>
+  struct Codec<pair<T1, T2>> {
+    static constexpr size_t MAX_SIZE = sizeof(uint16_t) + Codec<T1>::MAX_SIZE + Codec<T2>::MAX_SIZE;
+
+    static size_t size(const pair<T1, T2> &value) {
+      return sizeof(uint16_t) + Codec<T1>::size(value.first) + Codec<T2>::size(value.second);
+    }
+    static void write(char *out, const pair<T1, T2> &value) {
+      auto first_size = static_cast<uint16_t>(Codec<T1>::size(value.first));
+      std::memcpy(out, &first_size, sizeof(uint16_t));
+      Codec<T1>::write(out + sizeof(uint16_t), value.first);
+      Codec<T2>::write(out + sizeof(uint16_t) + first_size, value.second);
+    }
+    static pair<T1, T2> read(const char *in, size_t size) {
+      uint16_t first_size;
+      std::memcpy(&first_size, in, sizeof(uint16_t));
+      return {Codec<T1>::read(in + sizeof(uint16_t), first_size),
+              Codec<T2>::read(in + sizeof(uint16_t) + first_size, size - sizeof(uint16_t) - first_size)};
+    }
+  };
+
+  /**
+   * @brief a leaf of variable-length records, see BPT_SLOTTED_LEAF. The slots, each a key and the
+   * place of its record, grow from the front of the area in key order; the records, encoded by
+   * Codec, are packed against its end. It has the interface of BPTNode<Key, Value, Leaf> that BPT
+   * uses, with the thresholds in bytes: a record and its slot take at most RECORD_MAX, and a leaf
+   * keeps RECORD_MAX free, so that the insert before a split always fits.
+   */
+  template<typename Key, typename Value>
+  class SlottedLeaf {
+  public:
+    using value_type = pair<Key, Value>;
+
+  private:
+    //where a record is in the area, stored after the key of its slot
+    struct Place {
+      uint16_t offset;
+      uint16_t size;
+    };
+    static_assert(std::is_trivially_copyable_v<Key>);
+
+  public:
+    static constexpr size_t SLOT_SIZE = sizeof(Key) + sizeof(Place);
+#ifndef BPT_SMALL_SIZE
+    static constexpr size_t AREA = PAGESIZE - 64;
+    //at most an eighth of the area, so that a split or a borrow leaves both leaves above MERGE_T
+    static constexpr size_t RECORD_MAX = std::min(SLOT_SIZE + Codec<Value>::MAX_SIZE, AREA / 8);
+#else
+    static constexpr size_t RECORD_MAX = std::min(SLOT_SIZE + Codec<Value>::MAX_SIZE, size_t{128});
+    static constexpr size_t AREA = 8 * RECORD_MAX;
+#endif
+    //a leaf with at most MERGE_T bytes in use is underfull
+    static constexpr size_t MERGE_T = AREA / 4;
+    //bytes in use in a leaf that is as full as an insert leaves it without a split
+    static constexpr size_t FILL_T = AREA - 2 * RECORD_MAX;
+
+    page_id_t self_id_=INVALID_PAGE_ID;
+    page_id_t prev_node_id_=INVALID_PAGE_ID;
+    page_id_t next_node_id_=INVALID_PAGE_ID;
+    size_t current_size_=0;
+    //bytes of the records, which end at the end of area_
+    size_t heap_size_=0;
+
+  private:
+    char area_[AREA];
+
+    [[nodiscard]] Place place(index_type pos) const {
+      Place result;
+      std::memcpy(&result, area_ + pos * SLOT_SIZE + sizeof(Key), sizeof(Place));
+      return result;
+    }
+
+    void set_slot(index_type pos, const Key &key, Place where) {
+      std::memcpy(area_ + pos * SLOT_SIZE, &key, sizeof(Key));
+      std::memcpy(area_ + pos * SLOT_SIZE + sizeof(Key), &where, sizeof(Place));
+    }
+
+    //bytes the entry at pos takes, slot included
+    [[nodiscard]] size_t bytes(index_type pos) const {
+      return SLOT_SIZE + place(pos).size;
+    }
+
+    /**
+     * @brief insert key and the record of value so that it becomes the entry at pos
+     */
+    void insert_record(index_type pos, const Key &key, const Value &value) {
+      size_t size = footprint(value) - SLOT_SIZE;
+#ifdef BPT_TEST
+      if (used() + SLOT_SIZE + size > AREA) {
+        throw std::overflow_error("SlottedLeaf::insert_at: leaf is full");
+      }
+#endif
+      heap_size_ += size;
+      auto offset = static_cast<uint16_t>(AREA - heap_size_);
+      Codec<Value>::write(area_ + offset, value);
+      std::memmove(area_ + (pos + 1) * SLOT_SIZE, area_ + pos * SLOT_SIZE, (current_size_ - pos) * SLOT_SIZE);
+      set_slot(pos, key, {offset, static_cast<uint16_t>(size)});
+      ++current_size_;
+    }
+
+    /**
+     * @brief append the entries [begin, end) of from, copying their records as they are
+     */
+    void append(const SlottedLeaf &from, index_type begin, index_type end) {
+      for (index_type i = begin; i < end; ++i) {
+        Place where = from.place(i);
+        heap_size_ += where.size;
+        auto offset = static_cast<uint16_t>(AREA - heap_size_);
+        std::memcpy(area_ + offset, from.area_ + where.offset, where.size);
+        set_slot(current_size_++, from.key_at(i), {offset, where.size});
+      }
+    }
+
+    /**
+     * @brief keep only the entries [begin, end), their records packed again
+     */
+    void keep(index_type begin, index_type end) {
+      auto old = std::make_unique<SlottedLeaf>(*this);
+      current_size_ = 0;
+      heap_size_ = 0;
+      append(*old, begin, end);
+    }
+
+  public:
+    SlottedLeaf(page_id_t self_id,size_t current_size,value_type data[]):self_id_(self_id) {
+      for (size_t i = 0; i < current_size; ++i) {
+        push_back(data[i]);
+      }
+    }
+    SlottedLeaf(page_id_t self_id) : self_id_(self_id) {}
+
+    /**
+     * @return the bytes an entry with this value takes, slot included
+     * @throw std::length_error if that is more than RECORD_MAX
+     */
+    static size_t footprint(const Value &value) {
+      size_t size = SLOT_SIZE + Codec<Value>::size(value);
+      if (size > RECORD_MAX) {
+        throw std::length_error("SlottedLeaf: the entry is longer than a leaf record may be");
+      }
+      return size;
+    }
+
+    /**
+     * @brief binary search for the key
+     * @return the last index <= key
+     */
+    [[nodiscard]] index_type search(const Key &key) const {
+      index_type l = 0, r = current_size_;
+      while (l < r) {
+        index_type mid = l + (r - l) / 2;
+        if (key_at(mid) <= key) {
+          l = mid + 1;
+        } else {
+          r = mid;
+        }
+      }
+      if(l==0) {
+        return INVALID_PAGE_ID;
+      }
+      return l-1;
+    }
+
+    [[nodiscard]] Key key_at(index_type pos) const {
+      Key key;
+      std::memcpy(&key, area_ + pos * SLOT_SIZE, sizeof(Key));
+      return key;
+    }
+
+    /**
+     * @return the entry at pos, its record decoded
+     */
+    [[nodiscard]] value_type at(index_type pos) const {
+#ifdef BPT_TEST
+      if (pos >= current_size_) {
+        throw std::out_of_range("SlottedLeaf::at: position out of bounds");
+      }
+#endif
+      Place where = place(pos);
+      return {key_at(pos), Codec<Value>::read(area_ + where.offset, where.size)};
+    }
+
+    Key get_first() const {
+#ifdef BPT_TEST
+      if (current_size_ == 0) {
+        throw std::logic_error("SlottedLeaf::get_first: leaf is empty");
+      }
+#endif
+      return key_at(0);
+    }
+
+    /**
+     * @brief insert key,value after pos.;
+     */
+    void insert_at(index_type pos,const value_type& value) {
+      insert_record(pos + 1, value.first, value.second);
+    }
+
+    void push_back(const value_type &value) {
+      insert_record(current_size_, value.first, value.second);
+    }
+
+    /**
+     * @brief store value as the value of the entry at pos, keeping its key
+     * @return false, leaving the leaf as it is, if the record would not leave RECORD_MAX free
+     */
+    bool replace(index_type pos, const Value &value) {
+      size_t size = footprint(value) - SLOT_SIZE;
+      Place where = place(pos);
+      if (size == where.size) {
+        Codec<Value>::write(area_ + where.offset, value);
+        return true;
+      }
+      if (used() - where.size + size + RECORD_MAX > AREA) {
+        return false;
+      }
+      Key key = key_at(pos);
+      erase(pos);
+      insert_record(pos, key, value);
+      return true;
+    }
+
+    /**
+     * @brief erase the data at pos. pos should be at least 0;
+     */
+    void erase(index_type pos) {
+#ifdef BPT_TEST
+      if (pos >= current_size_) {
+        throw std::out_of_range("SlottedLeaf::erase: position out of bounds");
+      }
+#endif
+      Place gone = place(pos);
+      //the records below the erased one move up over it
+      size_t heap_begin = AREA - heap_size_;
+      std::memmove(area_ + heap_begin + gone.size, area_ + heap_begin, gone.offset - heap_begin);
+      heap_size_ -= gone.size;
+      std::memmove(area_ + pos * SLOT_SIZE, area_ + (pos + 1) * SLOT_SIZE, (current_size_ - pos - 1) * SLOT_SIZE);
+      --current_size_;
+      for (index_type i = 0; i < current_size_; ++i) {
+        Place where = place(i);
+        if (where.offset < gone.offset) {
+          where.offset += gone.size;
+          std::memcpy(area_ + i * SLOT_SIZE + sizeof(Key), &where, sizeof(Place));
+        }
+      }
+    }
+
+    /**
+     * @brief erase every entry for which pred(entry) holds, keeping the others in order
+     * @return the number of entries erased
+     */
+    template<typename Pred>
+    size_t erase_if(Pred &&pred) {
+      auto old = std::make_unique<SlottedLeaf>(*this);
+      current_size_ = 0;
+      heap_size_ = 0;
+      for (index_type i = 0; i < old->current_size_; ++i) {
+        if (!pred(old->at(i))) {
+          append(*old, i, i + 1);
+        }
+      }
+      return old->current_size_ - current_size_;
+    }
+
+    //bytes in use, slots and records
+    [[nodiscard]] size_t used() const {
+      return current_size_ * SLOT_SIZE + heap_size_;
+    }
+    [[nodiscard]] size_t load() const {
+      return used();
+    }
+    [[nodiscard]] bool is_underfull() const {
+      return used() <= MERGE_T;
+    }
+    [[nodiscard]] bool is_upper_safe() const {
+      return used() <= FILL_T;
+    }
+    [[nodiscard]] bool is_lower_safe() const {
+      return used() > MERGE_T + RECORD_MAX;
+    }
+
+    /**
+     * @brief move the upper half of the bytes in use to the new leaf at ptr
+     */
+    PageRef<SlottedLeaf> split(const PagePtr<SlottedLeaf>& ptr) {
+      size_t mid = 1, kept = bytes(0);
+      while (mid + 1 < current_size_ && kept + bytes(mid) <= used() / 2) {
+        kept += bytes(mid);
+        ++mid;
+      }
+      return split(ptr, mid);
+    }
+
+    /**
+     * @param mid the number of entries kept in this leaf, the rest move to the new leaf at ptr
+     */
+    PageRef<SlottedLeaf> split(const PagePtr<SlottedLeaf>& ptr, size_t mid) {
+#ifdef BPT_TEST
+      assert(mid > 0 && mid < current_size_);
+#endif
+      auto temp = std::make_unique<SlottedLeaf>(ptr.page_id());
+      temp->prev_node_id_ = self_id_;
+      temp->next_node_id_ = next_node_id_;
+      if (next_node_id_ != INVALID_PAGE_ID) {
+        PagePtr<SlottedLeaf>{next_node_id_,ptr.manager_}.get_ref()->prev_node_id_ = ptr.page_id();
+      }
+      next_node_id_ = ptr.page_id();
+      temp->append(*this, mid, current_size_);
+      keep(0, mid);
+      return ptr.make_ref(std::move(temp));
+    }
+
+    /**
+     * @brief append the right neighbour `right` to this leaf and free its page
+     * @return false if both do not fit into one leaf that could take an insert
+     */
+    bool absorb(SlottedLeaf &right, IOManager* manager) {
+#ifdef BPT_TEST
+      assert(right.prev_node_id_==self_id_ && next_node_id_==right.self_id_);
+#endif
+      if (used() + right.used() > FILL_T) {
+        return false;
+      }
+      if(right.next_node_id_!=INVALID_PAGE_ID) {
+        auto next_node = PagePtr<SlottedLeaf>{right.next_node_id_,manager}.get_ref();
+        next_node->prev_node_id_ = self_id_;
+      }
+      append(right, 0, right.current_size_);
+      next_node_id_ = right.next_node_id_;
+      manager->DeletePage(right.self_id_);
+      return true;
+    }
+
+    /**
+     * @brief move the last count entries of the left neighbour to the front of this leaf
+     */
+    void borrow_from_left(SlottedLeaf &left, size_t count) {
+#ifdef BPT_TEST
+      assert(count < left.current_size_);
+#endif
+      auto old = std::make_unique<SlottedLeaf>(*this);
+      current_size_ = 0;
+      heap_size_ = 0;
+      append(left, left.current_size_ - count, left.current_size_);
+      append(*old, 0, old->current_size_);
+      left.keep(0, left.current_size_ - count);
+    }
+
+    /**
+     * @brief move entries over from the fuller left neighbour, at most half the bytes it has more
+     */
+    void borrow_from_left(SlottedLeaf &left) {
+      size_t budget = (left.used() - used()) / 2;
+      size_t count = 1, moved = left.bytes(left.current_size_ - 1);
+      while (count + 1 < left.current_size_ && moved + left.bytes(left.current_size_ - 1 - count) <= budget) {
+        moved += left.bytes(left.current_size_ - 1 - count);
+        ++count;
+      }
+      borrow_from_left(left, count);
+    }
+
+    /**
+     * @brief move the first count entries of the right neighbour to the end of this leaf
+     */
+    void borrow_from_right(SlottedLeaf &right, size_t count) {
+#ifdef BPT_TEST
+      assert(count < right.current_size_);
+#endif
+      append(right, 0, count);
+      right.keep(count, right.current_size_);
+    }
+
+    /**
+     * @brief move entries over from the fuller right neighbour, at most half the bytes it has more
+     */
+    void borrow_from_right(SlottedLeaf &right) {
+      size_t budget = (right.used() - used()) / 2;
+      size_t count = 1, moved = right.bytes(0);
+      while (count + 1 < right.current_size_ && moved + right.bytes(count) <= budget) {
+        moved += right.bytes(count);
+        ++count;
+      }
+      borrow_from_right(right, count);
+    }
+
+    [[nodiscard]] page_id_t get_self() const {
+      return self_id_;
+    }
+
+    /**
+     * @brief the page format of the leaf, folded into the layout fingerprint of BPT
+     */
+    static constexpr hash_t layout() {
+      return mix(mix(mix(mix(Leaf) ^ AREA) ^ SLOT_SIZE) ^ RECORD_MAX);
+    }
+  };
+}
+
+#endif //SLOTTED_LEAF_H
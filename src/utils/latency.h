@@ -0,0 +1,149 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <limits>
+#include <ostream>
+
+namespace RFlowey {
+
+  /**
+   * @brief log-linear (HDR style) histogram of latencies in nanoseconds.
+   * Every power-of-two range is cut into SUB_BUCKETS linear buckets, so a recorded value
+   * is reported with a relative error below 1/SUB_BUCKETS, with a fixed 8KB footprint.
+   */
+  class LatencyHistogram {
+    static constexpr int SUB_BITS = 4;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BITS;
+    static constexpr int BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+    uint64_t counts_[BUCKETS]{};
+    uint64_t total_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t min_ = std::numeric_limits<uint64_t>::max();
+    uint64_t max_ = 0;
+
+    static int bucket_of(uint64_t value) {
+      if (value < SUB_BUCKETS) {
+        return static_cast<int>(value);
+      }
+      int shift = (63 - __builtin_clzll(value)) - SUB_BITS;
+      return (shift + 1) * SUB_BUCKETS + static_cast<int>((value >> shift) - SUB_BUCKETS);
+    }
+
+    /**
+     * @return the largest value that falls into the bucket
+     */
+    static uint64_t upper_of(int bucket) {
+      if (bucket < SUB_BUCKETS) {
+        return bucket;
+      }
+      int shift = bucket / SUB_BUCKETS - 1;
+      uint64_t low = static_cast<uint64_t>(SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+      return low + ((uint64_t{1} << shift) - 1);
+    }
+
+  public:
+    void record(uint64_t ns) {
+      ++counts_[bucket_of(ns)];
+      ++total_;
+      sum_ += ns;
+      min_ = std::min(min_, ns);
+      max_ = std::max(max_, ns);
+    }
+
+    void merge(const LatencyHistogram &other) {
+      for (int i = 0; i < BUCKETS; ++i) {
+        counts_[i] += other.counts_[i];
+      }
+      total_ += other.total_;
+      sum_ += other.sum_;
+      min_ = std::min(min_, other.min_);
+      max_ = std::max(max_, other.max_);
+    }
+
+    void reset() {
+      *this = LatencyHistogram{};
+    }
+
+    [[nodiscard]] uint64_t count() const { return total_; }
+    [[nodiscard]] uint64_t min() const { return total_ ? min_ : 0; }
+    [[nodiscard]] uint64_t max() const { return max_; }
+    [[nodiscard]] double mean() const { return total_ ? static_cast<double>(sum_) / total_ : 0; }
+
+    /**
+     * @param q quantile in [0,1], e.g. 0.99 for p99
+     * @return upper bound of the bucket holding the sample of rank ceil(q*count) (nearest rank),
+     * clamped to the observed max
+     */
+    [[nodiscard]] uint64_t percentile(double q) const {
+      if (total_ == 0) {
+        return 0;
+      }
+      //the epsilon keeps q*count that is whole up to rounding, like 0.99*100, from moving up a rank
+      auto rank = static_cast<uint64_t>(std::ceil(q * static_cast<double>(total_) - 1e-9));
+      rank = std::clamp<uint64_t>(rank, 1, total_);
+      uint64_t seen = 0;
+      for (int i = 0; i < BUCKETS; ++i) {
+        seen += counts_[i];
+        if (seen >= rank) {
+          return std::min(upper_of(i), max_);
+        }
+      }
+      return max_;
+    }
+
+    [[nodiscard]] uint64_t p50() const { return percentile(0.5); }
+    [[nodiscard]] uint64_t p99() const { return percentile(0.99); }
+    [[nodiscard]] uint64_t p999() const { return percentile(0.999); }
+
+    /**
+     * @brief print a one-line summary, all times in microseconds
+     */
+    void dump(std::ostream &os, const char *name) const {
+      auto us = [](uint64_t ns) { return static_cast<double>(ns) / 1000; };
+      //the caller's stream is left formatted as it was
+      std::ios_base::fmtflags flags = os.flags();
+      std::streamsize precision = os.precision();
+      os << std::fixed << std::setprecision(2)
+         << std::left << std::setw(8) << name << std::right
+         << " count=" << total_
+         << " min=" << us(min())
+         << " mean=" << mean() / 1000
+         << " p50=" << us(p50())
+         << " p99=" << us(p99())
+         << " p999=" << us(p999())
+         << " max=" << us(max_) << " (us)" << '\n';
+      os.flags(flags);
+      os.precision(precision);
+    }
+  };
+
+  /**
+   * @brief RAII timer, records the time between construction and destruction into a histogram
+   */
+  class LatencyTimer {
+    using clock = std::chrono::steady_clock;
+    LatencyHistogram &histogram_;
+    clock::time_point start_;
+  public:
+    explicit LatencyTimer(LatencyHistogram &histogram) : histogram_(histogram), start_(clock::now()) {}
+    LatencyTimer(const LatencyTimer &) = delete;
+    LatencyTimer &operator=(const LatencyTimer &) = delete;
+    ~LatencyTimer() {
+      histogram_.record(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start_).count());
+    }
+  };
+}
+
+#ifdef BPT_LATENCY_STATS
+#define BPT_LATENCY_SCOPE(histogram) ::RFlowey::LatencyTimer latency_timer_{histogram}
+#else
+#define BPT_LATENCY_SCOPE(histogram) ((void)0)
+#endif
+
+#endif //LATENCY_H
@@ -4,6 +4,8 @@
 #include <utility>
 #include <cstring>
 #include <cassert>
+#include <string>
+#include <string_view>
 
 
 namespace RFlowey {
@@ -91,6 +93,9 @@ constexpr bool operator>=(const pair<T1, T2>& lhs, const pair<T1, T2>& rhs) {
                 assign(c_str, len);
             }
         }
+        string(const char* data, size_t length) noexcept {
+            assign(data, length);
+        }
 
         // Copy constructor (defaulted is fine)
         string(const string& other) noexcept = default;
@@ -201,5 +206,31 @@ constexpr bool operator>=(const pair<T1, T2>& lhs, const pair<T1, T2>& rhs) {
         }
         return hash;
     }
+
+    //the polynomial of hash(string<N>) over the characters alone, for keys of any length
+    constexpr unsigned long long hash(std::string_view s) {
+        unsigned long long hash = 0;
+
+        for (char c : s) {
+            hash += c;
+            hash = (hash * 37);
+        }
+        if (hash == 0) {
+            hash = 114514;
+        }
+        return hash;
+    }
+
+    /**
+     * @brief splitmix64 finalizer, the key hashes are polynomial and weak in their low bits
+     */
+    constexpr unsigned long long mix(unsigned long long x) {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ull;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebull;
+        x ^= x >> 31;
+        return x;
+    }
 }
 #endif //UTILS_H
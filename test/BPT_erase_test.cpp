@@ -6,6 +6,7 @@
 #include <cassert>
 #include <map>
 #include <set>
+#include <random>
 
 // Define BPT_SMALL_SIZE to use smaller SIZEMAX for easier split testing
 #define BPT_SMALL_SIZE
@@ -402,6 +403,95 @@ void test_bpt_erase_insert_mixed_verbose(const std::string& db_filename_prefix)
 
     std::cout << "====== BPT Erase/Insert Mixed Test (VERBOSE) Passed ======" << std::endl;
 }
+// Mass deletes in random order: underfull nodes, first children included, must be merged with
+// or refilled from a sibling, so that every node that has one stays above MERGE_T
+void test_bpt_erase_rebalance(const std::string& db_filename_prefix) {
+    const std::string db_filename = db_filename_prefix + "_rebalance.dat";
+    std::cout << "\n====== Starting BPT Erase Rebalance Test ======" << std::endl;
+    std::remove(db_filename.c_str());
+    using Tree = RFlowey::BPT<RFlowey::string<64>, int, String64Hasher, IntHasher>;
+    using Leaf = RFlowey::BPTNode<RFlowey::pair<RFlowey::hash_t, RFlowey::hash_t>, RFlowey::pair<RFlowey::string<64>, int>, RFlowey::Leaf>;
+    const int n = 3000;
+    std::vector<int> ids(n);
+    for (int i = 0; i < n; ++i) ids[i] = i;
+    std::mt19937 rng(4242);
+    std::shuffle(ids.begin(), ids.end(), rng);
+    std::map<RFlowey::string<64>, std::vector<int>> reference;
+    {
+        Tree bpt(db_filename);
+        for (int id : ids) {
+            bpt.insert(make_rflowey_key("rb_", id), id);
+            reference[make_rflowey_key("rb_", id)].push_back(id);
+        }
+        assert(bpt.check_structure() > Leaf::MERGE_T);
+        std::shuffle(ids.begin(), ids.end(), rng);
+        for (int i = 0; i < n * 9 / 10; ++i) {
+            assert(bpt.erase(make_rflowey_key("rb_", ids[i]), ids[i]));
+            reference.erase(make_rflowey_key("rb_", ids[i]));
+            if (i % 100 == 0) {
+                // with BPT_LAZY_REBALANCE underfull leaves wait in a queue, which flush runs
+                bpt.flush();
+                assert(bpt.check_structure() > Leaf::MERGE_T);
+            }
+        }
+        bpt.flush();
+        assert(bpt.check_structure() > Leaf::MERGE_T);
+        verify_bpt_content(bpt, reference, "After erasing 90% in random order");
+    }
+    {
+        Tree bpt(db_filename);
+        verify_bpt_content(bpt, reference, "After reopen");
+        for (int i = n * 9 / 10; i < n; ++i) {
+            assert(bpt.erase(make_rflowey_key("rb_", ids[i]), ids[i]));
+        }
+        reference.clear();
+        verify_bpt_content(bpt, reference, "After erasing everything");
+        for (int i = 0; i < 200; ++i) {
+            bpt.insert(make_rflowey_key("rb_", i), i);
+            reference[make_rflowey_key("rb_", i)].push_back(i);
+        }
+        bpt.check_structure();
+        verify_bpt_content(bpt, reference, "After refilling");
+    }
+    std::remove(db_filename.c_str());
+    std::cout << "====== BPT Erase Rebalance Test Passed ======" << std::endl;
+}
+
+void test_bpt_erase_spanning_copies(const std::string& db_filename_prefix) {
+    const std::string db_filename = db_filename_prefix + "_spanning.dat";
+    std::cout << "\n====== Starting BPT Erase Spanning Copies Test ======" << std::endl;
+    std::remove(db_filename.c_str());
+    using Tree = RFlowey::BPT<RFlowey::string<64>, int, String64Hasher, IntHasher>;
+    const int copies = 60;
+    std::map<RFlowey::string<64>, std::vector<int>> reference;
+    std::mt19937 rng(2697);
+    {
+        Tree bpt(db_filename);
+        // copies of one pair span several leaves, with other keys on both sides
+        for (int i = 0; i < copies; ++i) {
+            bpt.insert(make_rflowey_key("dup_", 0), 7);
+            reference[make_rflowey_key("dup_", 0)].push_back(7);
+            int id = static_cast<int>(rng() % 200);
+            bpt.insert(make_rflowey_key("other_", id), id);
+            reference[make_rflowey_key("other_", id)].push_back(id);
+        }
+        bpt.check_structure();
+        // erasing the copies right of a separator leaves the rest to its left
+        for (int i = 0; i < copies; ++i) {
+            assert(bpt.erase(make_rflowey_key("dup_", 0), 7));
+            bpt.check_structure();
+            reference[make_rflowey_key("dup_", 0)].pop_back();
+            assert(bpt.find(make_rflowey_key("dup_", 0)).size() == reference[make_rflowey_key("dup_", 0)].size());
+        }
+        assert(!bpt.erase(make_rflowey_key("dup_", 0), 7));
+        reference.erase(make_rflowey_key("dup_", 0));
+        bpt.check_structure();
+        verify_bpt_content(bpt, reference, "After erasing every copy");
+    }
+    std::remove(db_filename.c_str());
+    std::cout << "====== BPT Erase Spanning Copies Test Passed ======" << std::endl;
+}
+
 int main() {
     const std::string base_db_filename = "bpt_small_non_random";
 
@@ -411,6 +501,10 @@ int main() {
     // Run Test 2: Erase and Insert Mixed
     test_bpt_erase_insert_mixed_verbose(base_db_filename);
 
+    test_bpt_erase_rebalance(base_db_filename);
+
+    test_bpt_erase_spanning_copies(base_db_filename);
+
 
     return 0;
 }
\ No newline at end of file
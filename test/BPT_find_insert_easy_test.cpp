@@ -7,6 +7,8 @@
 #include <map> // For verification
 #include <random> // For random operations in comprehensive test
 #include <set>    // For keeping track of keys in comprehensive test
+#include <filesystem> // For the page count of the ascending test
+#include <stdexcept>
 
 // Define BPT_SMALL_SIZE to use smaller SIZEMAX for easier split testing
 #define BPT_SMALL_SIZE
@@ -1279,6 +1281,80 @@ void test_bpt_super_duped_and_comprehensive_mixed(const std::string& db_filename
     std::cout << "====== BPT Super-Duped Keys & Comprehensive Mixed Test (Small SIZEMAX) Passed ======" << std::endl;
 }
 
+// Ascending keys take the append path and split the right edge 100/0, leaving full leaves behind
+void test_bpt_ascending_append(const std::string& db_filename_prefix) {
+    const std::string db_filename = db_filename_prefix + "_ascending.dat";
+    std::cout << "\n====== Starting BPT Ascending Append Test ======" << std::endl;
+    std::remove(db_filename.c_str());
+    using IntTree = RFlowey::BPT<int, int, IntHasher, IntHasher>;
+    const int n = 2000;
+    {
+        IntTree bpt(db_filename);
+        for (int i = 0; i < n; ++i) {
+            bpt.insert(i, i * 2);
+        }
+        for (int i = 0; i < n; i += 7) {
+            auto values = bpt.find(i);
+            assert(values.size() == 1 && values[0] == i * 2);
+        }
+    }
+    // 50/50 splits would leave about SPLIT_T/2 entries per leaf, n/4 leaves with SIZEMAX 12
+    auto pages = std::filesystem::file_size(db_filename) / RFlowey::PAGESIZE;
+    std::cout << "Pages after " << n << " ascending inserts: " << pages << std::endl;
+#ifndef BPT_BLOOM_FILTER
+    // with BPT_SMALL_SIZE a filter page holds 4 words, the filter of 2000 keys takes more pages than the tree
+    assert(pages < n / 5);
+#endif
+    {
+        // the fast path must fall back once keys stop increasing, and after merges
+        IntTree bpt(db_filename);
+        for (int i = n - 1; i >= 0; i -= 2) {
+            assert(bpt.erase(i, i * 2));
+        }
+        for (int i = -100; i < 0; ++i) {
+            bpt.insert(i, i * 2);
+        }
+        for (int i = n; i < n + 300; ++i) {
+            bpt.insert(i, i * 2);
+        }
+        for (int i = -100; i < n + 300; ++i) {
+            auto values = bpt.find(i);
+            bool present = i < 0 || i >= n || i % 2 == 0;
+            assert(values.size() == (present ? 1u : 0u));
+            assert(!present || values[0] == i * 2);
+        }
+    }
+    std::remove(db_filename.c_str());
+    std::cout << "====== BPT Ascending Append Test Passed ======" << std::endl;
+}
+
+// A file is refused by a tree of another key, value or node layout, and still opens with its own
+void test_bpt_layout_mismatch(const std::string& db_filename_prefix) {
+    const std::string db_filename = db_filename_prefix + "_layout.dat";
+    std::cout << "\n====== Starting BPT Layout Mismatch Test ======" << std::endl;
+    std::remove(db_filename.c_str());
+    using StringTree = RFlowey::BPT<RFlowey::string<64>, int, String64Hasher, IntHasher>;
+    using IntTree = RFlowey::BPT<int, int, IntHasher, IntHasher>;
+    {
+        StringTree bpt(db_filename);
+        bpt.insert(RFlowey::string<64>("key"), 1);
+    }
+    bool refused = false;
+    try {
+        IntTree bpt(db_filename);
+    } catch (const std::runtime_error&) {
+        refused = true;
+    }
+    assert(refused);
+    {
+        StringTree bpt(db_filename);
+        auto found = bpt.find(RFlowey::string<64>("key"));
+        assert(found.size() == 1 && found[0] == 1);
+    }
+    std::remove(db_filename.c_str());
+    std::cout << "====== BPT Layout Mismatch Test Passed ======" << std::endl;
+}
+
 int main() {
     freopen("test.log","w",stdout);
 
@@ -1304,6 +1380,8 @@ int main() {
     // Test 5: Comprehensive test (manages its own file and map)
     test_bpt_super_duped_and_comprehensive_mixed(base_db_filename);
     test_bpt_comprehensive_small(base_db_filename);
+    test_bpt_ascending_append(base_db_filename);
+    test_bpt_layout_mismatch(base_db_filename);
 
 
     std::cout << "\nAll BPT tests completed successfully." << std::endl;
@@ -4,6 +4,10 @@
 #include <cassert>
 #include <cstring> // For strcmp
 #include <cstdio>  // For remove()
+#include <utility> // For std::as_const
+#include <map>
+#include <mutex>
+#include <vector>
 
 
 // --- Include your headers ---
@@ -11,6 +15,7 @@
 #include "src/disk/IO_utils.h"
 #include "src/disk/IO_manager.h"
 #include "src/disk/serialize.h"
+#include "src/disk/write_back.h"
 #include "src/common.h"
 // --------------------------
 
@@ -190,10 +195,95 @@ void run_manager_tests(RFlowey::IOManager* manager, const std::string& manager_t
     }
     std::cout << "Move test verification PASSED." << std::endl;
 
+    // 8. Pinned pages: reads share the resident page, writes go through to the manager
+    std::cout << "Testing pinned pages..." << std::endl;
+    {
+        manager->Pin(pid);
+        assert(manager->Pinned(pid) != nullptr);
+        assert(manager->Pinned(pid_make_ref_only) == nullptr);
+        {
+            RFlowey::PageRef<TestData> pinned_ref1 = page_ptr.get_ref();
+            RFlowey::PageRef<TestData> pinned_ref2 = page_ptr.get_ref();
+            assert(pinned_ref1.is_resident() && pinned_ref2.is_resident());
+            assert(&*std::as_const(pinned_ref1) == &*std::as_const(pinned_ref2)); // same in-memory object
+            pinned_ref1->id = 123;
+            assert(std::as_const(pinned_ref2)->id == 123);
+        }
+        // bypass the resident copy: the modification must already be on the manager's side
+        {
+            auto raw_page = manager->ReadPage(pid);
+            TestData on_disk;
+            std::memcpy(&on_disk, raw_page->get_data(), sizeof(TestData));
+            assert(on_disk.id == 123);
+        }
+        {
+            RFlowey::PageRef<TestData> remade = page_ptr.make_ref(5, 5.5, "Remade Pinned", true);
+            assert(remade.is_resident());
+        }
+        {
+            const RFlowey::PageRef<TestData> reread = page_ptr.get_ref();
+            assert(reread->id == 5);
+        }
+        manager->Unpin(pid);
+        assert(manager->Pinned(pid) == nullptr);
+        RFlowey::PageRef<TestData> unpinned_ref = page_ptr.get_ref();
+        assert(!unpinned_ref.is_resident());
+        assert(std::strcmp(std::as_const(unpinned_ref)->name, "Remade Pinned") == 0);
+    }
+    std::cout << "Pinned page verification PASSED." << std::endl;
+
 
     std::cout << "--- " << manager_type << " Tests PASSED ---" << std::endl << std::endl;
 }
 
+// --- Write-back buffer: sorted, coalesced, read-your-writes ---
+void run_write_back_tests(bool background) {
+    std::cout << "--- Testing WriteBackBuffer (" << (background ? "background" : "inline") << ") ---" << std::endl;
+    std::mutex written_mutex;
+    std::map<RFlowey::page_id_t, char> written; // first byte of every written page
+    std::vector<std::pair<RFlowey::page_id_t, size_t>> runs;
+    auto writer = [&](RFlowey::page_id_t first, const char* data, size_t count) {
+        std::lock_guard lock(written_mutex);
+        runs.emplace_back(first, count);
+        for (size_t i = 0; i < count; ++i) {
+            written[first + static_cast<RFlowey::page_id_t>(i)] = data[i * RFlowey::PAGESIZE];
+        }
+    };
+    auto make_page = [](char tag) { return std::vector<char>(RFlowey::PAGESIZE, tag); };
+    {
+        RFlowey::WriteBackBuffer buffer(writer, background);
+        for (RFlowey::page_id_t id : {5, 3, 4, 10, 11}) {
+            buffer.Put(id, make_page(static_cast<char>('a' + id)).data());
+        }
+        buffer.Put(3, make_page('z').data()); // newer version replaces the pending one
+
+        std::vector<char> out(RFlowey::PAGESIZE);
+        assert(buffer.Get(3, out.data()) && out[0] == 'z' && out[RFlowey::PAGESIZE - 1] == 'z');
+        assert(!buffer.Get(7, out.data()));
+
+        buffer.Flush();
+        std::lock_guard lock(written_mutex);
+        assert(written.size() == 5);
+        assert(written[3] == 'z' && written[4] == 'a' + 4 && written[11] == 'a' + 11);
+        // 3,4,5 and 10,11 are each written by one call, in page order
+        assert(runs.size() == 2);
+        assert(runs[0].first == 3 && runs[0].second == 3);
+        assert(runs[1].first == 10 && runs[1].second == 2);
+    }
+    std::cout << "Flush barrier and coalescing PASSED." << std::endl;
+
+    runs.clear();
+    written.clear();
+    {
+        RFlowey::WriteBackBuffer buffer(writer, background);
+        for (size_t i = 0; i < RFlowey::FLUSH_BATCH_PAGES + 10; ++i) {
+            buffer.Put(static_cast<RFlowey::page_id_t>(1000 - i), make_page('q').data());
+        }
+    } // destruction writes everything that is still pending
+    assert(written.size() == RFlowey::FLUSH_BATCH_PAGES + 10);
+    std::cout << "Size policy and final drain PASSED." << std::endl;
+}
+
 // --- Main Function ---
 int main() {
     std::cout << "Starting IO Utils Tests..." << std::endl;
@@ -220,6 +310,9 @@ int main() {
     }
 
 
+    run_write_back_tests(true);
+    run_write_back_tests(false);
+
     std::cout << "All IO Utils Tests Completed Successfully!" << std::endl;
     return 0;
 }
\ No newline at end of file
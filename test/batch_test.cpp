@@ -0,0 +1,81 @@
+#define BPT_SMALL_SIZE
+#define BPT_TEST
+
+#include "src/BPT.h"
+#include "test/reference.h"
+
+RFlowey::string<64> key_of(int id) {
+    return RFlowey::string<64>("batch_" + std::to_string(id));
+}
+
+template<typename Tree>
+void verify_found(Tree& bpt, const Reference& reference, int key_count, std::vector<std::vector<int>>& found, const char* stage) {
+    // in a scrambled order, with repeats, through buffers left over from the last call
+    std::vector<RFlowey::string<64>> keys;
+    std::vector<int> ids;
+    for (int id = 0; id < 2 * key_count; ++id) {
+        int scrambled = (id * 7919) % (2 * key_count);
+        keys.push_back(key_of(scrambled));
+        ids.push_back(scrambled);
+        if (id % 5 == 0) {
+            keys.push_back(key_of(scrambled));
+            ids.push_back(scrambled);
+        }
+    }
+    bpt.find_many(keys, found);
+    assert(found.size() >= keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        expect_same(ids[i], expected_of(reference, ids[i]), found[i], stage);
+    }
+}
+
+template<typename KeyHash>
+void test_random_against_reference(const std::string& db_filename) {
+    using Tree = RFlowey::BPT<RFlowey::string<64>, int, KeyHash, IntHasher>;
+    std::remove(db_filename.c_str());
+    const int key_count = 300;
+    const int value_count = 40;
+    Reference reference;
+    std::vector<std::vector<int>> found;
+    std::mt19937 rng(8642);
+    for (int session = 0; session < 2; ++session) {
+        Tree bpt(db_filename);
+        verify_found(bpt, reference, key_count, found, "reopen");
+        for (int round = 0; round < 30; ++round) {
+            // a batch of new pairs, runs of neighbouring and repeated keys among them
+            std::vector<RFlowey::string<64>> keys;
+            std::vector<int> values;
+            int batch = 1 + static_cast<int>(rng() % 300);
+            for (int i = 0; i < batch; ++i) {
+                int id = rng() % key_count;
+                // values differ across keys, keys of one hash never share a tree key
+                int value = id * value_count + static_cast<int>(rng() % value_count);
+                if (reference[id].insert(value).second) {
+                    keys.push_back(key_of(id));
+                    values.push_back(value);
+                }
+            }
+            bpt.insert_many(keys, values);
+            // single erases between the batches
+            for (int i = 0; i < 60; ++i) {
+                int id = rng() % key_count;
+                int value = id * value_count + static_cast<int>(rng() % value_count);
+                apply_write(bpt, reference, key_of, id, value, true);
+            }
+            verify_found(bpt, reference, key_count, found, "after batch");
+        }
+        bpt.check_structure();
+    }
+    std::remove(db_filename.c_str());
+}
+
+int main() {
+    std::cout << "--- insert_many and find_many against a reference ---" << std::endl;
+    test_random_against_reference<String64Hasher>("batch.dat");
+    std::cout << "--- Distinct hashes passed ---" << std::endl;
+    // few distinct hashes, so that a batch lands many pairs in the same run of leaves
+    test_random_against_reference<CollidingHasher<7>>("batch_colliding.dat");
+    std::cout << "--- Shared hashes passed ---" << std::endl;
+    std::cout << "All batch tests passed." << std::endl;
+    return 0;
+}
@@ -0,0 +1,155 @@
+#include <iostream>
+#include <string>
+#include <cassert>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <set>
+#include <random>
+#include <vector>
+
+#define BPT_SMALL_SIZE
+#define BPT_TEST
+
+#include "src/blob.h"
+
+struct String64Hasher {
+    RFlowey::hash_t operator()(const RFlowey::string<64>& s) const {
+        return RFlowey::hash(s);
+    }
+};
+
+using Tree = RFlowey::BlobBPT<RFlowey::string<64>, String64Hasher>;
+using Reference = std::map<std::string, std::set<std::string>>;
+
+std::string make_value(std::mt19937& rng) {
+    // from empty to several pages
+    static const size_t lengths[] = {0, 1, 100, RFlowey::BlobPage::CAPACITY, RFlowey::BlobPage::CAPACITY + 1, 3000, 9000};
+    std::string value(lengths[rng() % 7], '\0');
+    for (auto& c : value) c = static_cast<char>('a' + rng() % 26);
+    return value;
+}
+
+void verify(Tree& bpt, const Reference& reference, int key_count, const char* stage) {
+    for (int k = 0; k < key_count; ++k) {
+        std::string key = "key" + std::to_string(k);
+        std::multiset<std::string> expected;
+        auto it = reference.find(key);
+        if (it != reference.end()) {
+            expected.insert(it->second.begin(), it->second.end());
+        }
+        auto found = bpt.find(RFlowey::string<64>(key));
+        std::multiset<std::string> got;
+        for (size_t i = 0; i < found.size(); ++i) got.insert(found[i]);
+        if (got != expected) {
+            std::cerr << "Mismatch for " << key << " at " << stage << std::endl;
+            assert(false);
+        }
+    }
+}
+
+void test_random_against_reference() {
+    std::cout << "--- Random workload across sessions ---" << std::endl;
+    const std::string db_filename = "blob_random.dat";
+    std::remove(db_filename.c_str());
+    const int key_count = 30;
+    Reference reference;
+    std::mt19937 rng(20240615);
+    for (int session = 0; session < 3; ++session) {
+        Tree bpt(db_filename);
+        verify(bpt, reference, key_count, "reopen");
+        for (int op = 0; op < 1500; ++op) {
+            std::string key = "key" + std::to_string(rng() % key_count);
+            auto& values = reference[key];
+            if (values.empty() || rng() % 2 == 0) {
+                std::string value = make_value(rng);
+                if (values.insert(value).second) {
+                    bpt.insert(RFlowey::string<64>(key), value);
+                }
+            } else {
+                auto victim = values.begin();
+                std::advance(victim, rng() % values.size());
+                assert(bpt.erase(RFlowey::string<64>(key), *victim));
+                assert(!bpt.erase(RFlowey::string<64>(key), *victim));
+                values.erase(victim);
+            }
+        }
+        verify(bpt, reference, key_count, "end of session");
+    }
+    std::remove(db_filename.c_str());
+    std::cout << "--- Random workload across sessions passed ---" << std::endl;
+}
+
+void test_pages_are_reused() {
+    std::cout << "--- Freed pages are reused ---" << std::endl;
+    const std::string db_filename = "blob_reuse.dat";
+    std::remove(db_filename.c_str());
+    RFlowey::string<64> key("big");
+    std::string value(20000, 'v');
+    std::uintmax_t size;
+    {
+        Tree bpt(db_filename);
+        for (int i = 0; i < 20; ++i) {
+            value[0] = static_cast<char>('a' + i);
+            bpt.insert(key, value);
+        }
+        bpt.flush();
+        size = std::filesystem::file_size(db_filename);
+        for (int i = 0; i < 20; ++i) {
+            value[0] = static_cast<char>('a' + i);
+            assert(bpt.erase(key, value));
+        }
+    }
+    {
+        // the free list survives the reopen
+        Tree bpt(db_filename);
+        assert(bpt.find(key).empty());
+        for (int i = 0; i < 20; ++i) {
+            value[0] = static_cast<char>('A' + i);
+            bpt.insert(key, value);
+        }
+        bpt.flush();
+        // 100 value pages were freed; only tree splits, which do not reuse pages, may grow the file
+        assert(std::filesystem::file_size(db_filename) <= size + 8 * RFlowey::PAGESIZE);
+        auto found = bpt.find(key);
+        assert(found.size() == 20);
+        for (size_t i = 0; i < found.size(); ++i) assert(found[i].size() == value.size());
+    }
+    std::remove(db_filename.c_str());
+    std::cout << "--- Freed pages are reused passed ---" << std::endl;
+}
+
+void test_duplicate_values() {
+    std::cout << "--- Duplicate values ---" << std::endl;
+    const std::string db_filename = "blob_duplicates.dat";
+    std::remove(db_filename.c_str());
+    RFlowey::string<64> key("k");
+    std::string value(5000, 'a');
+    std::string other(5000, 'z');
+    {
+        Tree bpt(db_filename);
+        // enough copies to span several leaves
+        const int copies = 30;
+        for (int i = 0; i < copies; ++i) bpt.insert(key, value);
+        for (int i = copies; i > 0; --i) {
+            assert(bpt.erase(key, value));
+            // the pages freed by the erase are reused here, they must not be those of a surviving copy
+            bpt.insert(RFlowey::string<64>("other" + std::to_string(i)), other);
+            auto found = bpt.find(key);
+            assert(found.size() == static_cast<size_t>(i - 1));
+            for (size_t j = 0; j < found.size(); ++j) assert(found[j] == value);
+        }
+        assert(!bpt.erase(key, value));
+        assert(bpt.find(RFlowey::string<64>("other1")).size() == 1);
+    }
+    std::remove(db_filename.c_str());
+    std::cout << "--- Duplicate values passed ---" << std::endl;
+}
+
+int main() {
+    test_random_against_reference();
+    test_pages_are_reused();
+    test_duplicate_values();
+    std::cout << "All blob tests passed." << std::endl;
+    return 0;
+}
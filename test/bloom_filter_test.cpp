@@ -0,0 +1,114 @@
+#define BPT_SMALL_SIZE
+#define BPT_TEST
+#define BPT_BLOOM_FILTER
+
+#include "src/BPT.h"
+#include "test/reference.h"
+
+using Tree = RFlowey::BPT<RFlowey::string<64>, int, String64Hasher, IntHasher>;
+
+RFlowey::string<64> key_of(int id) {
+    return RFlowey::string<64>("bloom_" + std::to_string(id));
+}
+
+void test_filter() {
+    std::cout << "--- Filter alone ---" << std::endl;
+    const std::string db_filename = "bloom_filter.dat";
+    std::remove(db_filename.c_str());
+    const int n = 1000;
+    std::mt19937_64 rng(4242);
+    std::vector<RFlowey::hash_t> added(n);
+    for (auto& hash : added) hash = rng();
+    RFlowey::page_id_t head;
+    {
+        RFlowey::SimpleDiskManager manager(db_filename);
+        RFlowey::BloomFilter filter;
+        assert(!filter.open(&manager, RFlowey::INVALID_PAGE_ID));
+        filter.reset(n);
+        for (auto hash : added) filter.add(hash);
+        assert(!filter.full());
+        filter.save();
+        head = filter.head();
+        assert(head != RFlowey::INVALID_PAGE_ID);
+        // a resized filter keeps its pages, growing or shrinking the chain at the end
+        filter.reset(4 * n);
+        for (auto hash : added) filter.add(hash);
+        filter.save();
+        assert(filter.head() == head);
+        filter.reset(n);
+        for (auto hash : added) filter.add(hash);
+        filter.save();
+        assert(filter.head() == head);
+    }
+    {
+        RFlowey::SimpleDiskManager manager(db_filename);
+        RFlowey::BloomFilter filter;
+        assert(filter.open(&manager, head));
+        assert(filter.count() == n);
+        for (auto hash : added) assert(filter.may_contain(hash));
+        int false_positives = 0;
+        for (int i = 0; i < 10 * n; ++i) {
+            false_positives += filter.may_contain(rng());
+        }
+        std::cout << "false positives: " << false_positives << " / " << 10 * n << std::endl;
+        assert(false_positives < n / 4);
+        for (int i = 0; i < n / 2; ++i) filter.note_erase();
+        assert(!filter.stale());
+        filter.note_erase();
+        assert(filter.stale());
+    }
+    std::remove(db_filename.c_str());
+    std::cout << "--- Filter alone passed ---" << std::endl;
+}
+
+void test_random_against_reference() {
+    std::cout << "--- Random workload across sessions ---" << std::endl;
+    // the filter starts at one page and grows with the inserts; half of the lookups are for keys never inserted
+    run_sessions<Tree>("bloom_random.dat",
+                       Workload{.ops = 4000, .key_count = 600, .value_count = 8, .verify_every = 1000, .verify_span = 2},
+                       1357, key_of, [](Tree&, const Reference&) {});
+    std::cout << "--- Random workload passed ---" << std::endl;
+}
+
+void test_rebuild_after_erase() {
+    std::cout << "--- Rebuild after erasing most keys ---" << std::endl;
+    const std::string db_filename = "bloom_erase.dat";
+    std::remove(db_filename.c_str());
+    const int n = 2000;
+    Reference reference;
+    {
+        Tree bpt(db_filename);
+        for (int id = 0; id < n; ++id) {
+            bpt.insert(key_of(id), id);
+            reference[id].insert(id);
+        }
+        for (int id = 0; id < n; ++id) {
+            if (id % 10 != 0) {
+                assert(bpt.erase(key_of(id), id));
+                reference.erase(id);
+            }
+        }
+        // the filter is stale now, flush rebuilds it from the remaining entries
+        bpt.flush();
+        verify(bpt, reference, key_of, 2 * n, "after flush");
+        for (int id = 1; id < n; id += 10) {
+            bpt.insert(key_of(id), id);
+            reference[id].insert(id);
+        }
+        verify(bpt, reference, key_of, 2 * n, "after refilling");
+    }
+    {
+        Tree bpt(db_filename);
+        verify(bpt, reference, key_of, 2 * n, "after reopen");
+    }
+    std::remove(db_filename.c_str());
+    std::cout << "--- Rebuild after erase passed ---" << std::endl;
+}
+
+int main() {
+    test_filter();
+    test_random_against_reference();
+    test_rebuild_after_erase();
+    std::cout << "All bloom filter tests passed." << std::endl;
+    return 0;
+}
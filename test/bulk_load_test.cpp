@@ -0,0 +1,147 @@
+#include <iostream>
+#include <string>
+#include <cassert>
+#include <cstdio>
+#include <map>
+#include <set>
+#include <random>
+#include <vector>
+
+#define BPT_SMALL_SIZE
+#define BPT_TEST
+
+#include "src/BPT.h"
+
+struct String64Hasher {
+    RFlowey::hash_t operator()(const RFlowey::string<64>& s) const {
+        return RFlowey::hash(s);
+    }
+};
+
+// few distinct hashes, so that runs of equal keys cross the boundaries of the threads' runs
+struct CollidingHasher {
+    RFlowey::hash_t operator()(const RFlowey::string<64>& s) const {
+        return RFlowey::hash(s) % 5 + 1;
+    }
+};
+
+struct IntHasher {
+    RFlowey::hash_t operator()(const int& v) const {
+        return static_cast<RFlowey::hash_t>(static_cast<long long>(v)-std::numeric_limits<int>::min());
+    }
+};
+
+using Leaf = RFlowey::BPTNode<RFlowey::pair<RFlowey::hash_t, RFlowey::hash_t>, RFlowey::pair<RFlowey::string<64>, int>, RFlowey::Leaf>;
+using Reference = std::map<std::string, std::set<int>>;
+
+RFlowey::string<64> key_of(int id) {
+    return RFlowey::string<64>("bulk_" + std::to_string(id));
+}
+
+template<typename Tree>
+void verify(Tree& bpt, const Reference& reference, int key_count, const char* stage) {
+    for (int id = 0; id < 2 * key_count; ++id) {
+        std::vector<int> expected;
+        auto it = reference.find("bulk_" + std::to_string(id));
+        if (it != reference.end()) {
+            expected.assign(it->second.begin(), it->second.end());
+        }
+        auto found = bpt.find(key_of(id));
+        std::vector<int> got;
+        for (size_t i = 0; i < found.size(); ++i) got.push_back(found[i]);
+        if (got != expected) {
+            std::cerr << "Mismatch for id " << id << " at " << stage << std::endl;
+            assert(false);
+        }
+    }
+}
+
+template<typename KeyHash>
+void test_load_then_modify(const std::string& db_filename, int pair_count, size_t threads) {
+    using Tree = RFlowey::BPT<RFlowey::string<64>, int, KeyHash, IntHasher>;
+    std::remove(db_filename.c_str());
+    const int key_count = 400;
+    const int value_count = 50;
+    Reference reference;
+    std::mt19937 rng(pair_count * 31 + threads);
+    {
+        // values differ across keys, keys of one hash never share a tree key
+        std::vector<RFlowey::string<64>> keys;
+        std::vector<int> values;
+        while (static_cast<int>(keys.size()) < pair_count) {
+            int id = rng() % key_count;
+            int value = id * value_count + static_cast<int>(rng() % value_count);
+            if (reference["bulk_" + std::to_string(id)].insert(value).second) {
+                keys.push_back(key_of(id));
+                values.push_back(value);
+            }
+        }
+        Tree bpt(db_filename);
+        bpt.bulk_load(keys, values, threads);
+        verify(bpt, reference, key_count, "after load");
+        size_t min_size = bpt.check_structure();
+        assert(pair_count < Leaf::SPLIT_T || min_size > Leaf::MERGE_T);
+    }
+    {
+        // the loaded tree splits and merges like any other
+        Tree bpt(db_filename);
+        verify(bpt, reference, key_count, "reopen");
+        for (int op = 0; op < 4000; ++op) {
+            int id = rng() % key_count;
+            int value = id * value_count + static_cast<int>(rng() % value_count);
+            std::string key = "bulk_" + std::to_string(id);
+            if (rng() % 2 == 0) {
+                if (reference[key].insert(value).second) {
+                    bpt.insert(key_of(id), value);
+                }
+            } else {
+                bool expected = reference[key].erase(value) > 0;
+                assert(bpt.erase(key_of(id), value) == expected);
+            }
+        }
+        verify(bpt, reference, key_count, "after modifications");
+        bpt.check_structure();
+    }
+    std::remove(db_filename.c_str());
+}
+
+void test_load_into_filled_tree() {
+    std::cout << "--- Loading into a tree with entries ---" << std::endl;
+    using Tree = RFlowey::BPT<RFlowey::string<64>, int, String64Hasher, IntHasher>;
+    const std::string db_filename = "bulk_load_filled.dat";
+    std::remove(db_filename.c_str());
+    {
+        Tree bpt(db_filename);
+        Reference reference;
+        for (int id = 0; id < 100; ++id) {
+            bpt.insert(key_of(id), id);
+            reference["bulk_" + std::to_string(id)].insert(id);
+        }
+        std::vector<RFlowey::string<64>> keys;
+        std::vector<int> values;
+        for (int id = 50; id < 300; ++id) {
+            keys.push_back(key_of(id));
+            values.push_back(id + 1000);
+            reference["bulk_" + std::to_string(id)].insert(id + 1000);
+        }
+        bpt.bulk_load(keys, values, 4);
+        verify(bpt, reference, 300, "after load into a filled tree");
+        bpt.check_structure();
+    }
+    std::remove(db_filename.c_str());
+    std::cout << "--- Filled tree passed ---" << std::endl;
+}
+
+int main() {
+    std::cout << "--- Bulk load against a reference ---" << std::endl;
+    for (int pair_count : {0, 1, 7, 100, 5000}) {
+        for (size_t threads : {1, 3, 8}) {
+            test_load_then_modify<String64Hasher>("bulk_load.dat", pair_count, threads);
+            test_load_then_modify<CollidingHasher>("bulk_load_colliding.dat", pair_count, threads);
+        }
+    }
+    std::cout << "--- Bulk load passed ---" << std::endl;
+    test_load_into_filled_tree();
+    std::cout << "All bulk load tests passed." << std::endl;
+    return 0;
+}
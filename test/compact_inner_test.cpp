@@ -0,0 +1,65 @@
+#include <stdexcept>
+
+#define BPT_SMALL_SIZE
+#define BPT_TEST
+#define BPT_COMPACT_INNER
+
+#include "src/BPT.h"
+#include "test/reference.h"
+
+using Tree = RFlowey::BPT<RFlowey::string<64>, int, String64Hasher, IntHasher>;
+
+static_assert(sizeof(RFlowey::pair<RFlowey::packed_key, RFlowey::child_id_t>) == 20);
+
+RFlowey::string<64> key_of(int id) {
+    return RFlowey::string<64>("key" + std::to_string(id));
+}
+
+void test_packed_key_order() {
+    std::cout << "--- Packed key order ---" << std::endl;
+    using key_type = RFlowey::pair<RFlowey::hash_t, RFlowey::hash_t>;
+    std::vector<key_type> keys = {{0, 0}, {0, 1}, {1, 0}, {~0ull, 5}, {~0ull, ~0ull}};
+    for (const auto& a : keys) {
+        RFlowey::packed_key packed = a;
+        assert(key_type(packed) == a);
+        for (const auto& b : keys) {
+            assert((packed < b) == (a < b));
+            assert((packed <= b) == (a <= b));
+            assert((packed == b) == (a == b));
+        }
+    }
+    std::cout << "--- Packed key order passed ---" << std::endl;
+}
+
+void test_child_id_range() {
+    std::cout << "--- Child id range ---" << std::endl;
+    const long last = std::numeric_limits<RFlowey::child_id_t>::max();
+    assert(RFlowey::to_child_id(0) == 0);
+    assert(RFlowey::to_child_id(last) == last);
+    for (RFlowey::page_id_t id : {last + 1, -1L}) {
+        bool thrown = false;
+        try {
+            RFlowey::to_child_id(id);
+        } catch (const std::overflow_error&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+    std::cout << "--- Child id range passed ---" << std::endl;
+}
+
+void test_random_against_reference() {
+    std::cout << "--- Random workload across sessions ---" << std::endl;
+    run_sessions<Tree>("compact_inner_random.dat",
+                       Workload{.ops = 8000, .key_count = 300, .value_count = 100, .erase_one_in = 4}, 20240613, key_of,
+                       [](Tree& bpt, const Reference&) { bpt.check_structure(); });
+    std::cout << "--- Random workload across sessions passed ---" << std::endl;
+}
+
+int main() {
+    test_packed_key_order();
+    test_child_id_range();
+    test_random_against_reference();
+    std::cout << "All compact inner node tests passed." << std::endl;
+    return 0;
+}
@@ -0,0 +1,168 @@
+#define BPT_SMALL_SIZE
+#define BPT_TEST
+
+#include "src/BPT.h"
+#include "test/reference.h"
+
+// a value identified by its id, whose version an upsert replaces
+struct Record {
+    int id = 0;
+    int version = 0;
+};
+
+struct RecordHasher {
+    RFlowey::hash_t operator()(const Record& r) const {
+        return static_cast<RFlowey::hash_t>(r.id) + 1;
+    }
+};
+
+using Tree = RFlowey::BPT<RFlowey::string<64>, Record, String64Hasher, RecordHasher>;
+// key id -> record id -> version
+using Versions = std::map<int, std::map<int, int>>;
+
+RFlowey::string<64> key_of(int k) {
+    return RFlowey::string<64>("cond_" + std::to_string(k));
+}
+
+void verify(Tree& bpt, const Versions& versions, int key_count, const char* stage) {
+    for (int k = 0; k < key_count; ++k) {
+        std::vector<std::pair<int, int>> expected;
+        auto it = versions.find(k);
+        if (it != versions.end()) {
+            expected.assign(it->second.begin(), it->second.end());
+        }
+        auto found = bpt.find(key_of(k));
+        std::vector<std::pair<int, int>> got;
+        for (size_t i = 0; i < found.size(); ++i) got.emplace_back(found[i].id, found[i].version);
+        expect_same(k, expected, got, stage);
+    }
+}
+
+void test_random_against_reference() {
+    std::cout << "--- Conditional writes against a reference ---" << std::endl;
+    const std::string db_filename = "conditional_write.dat";
+    std::remove(db_filename.c_str());
+    const int key_count = 40;
+    const int id_count = 50;
+    Versions versions;
+    std::mt19937 rng(112233);
+    for (int session = 0; session < 3; ++session) {
+        Tree bpt(db_filename);
+        verify(bpt, versions, key_count, "reopen");
+        for (int op = 0; op < 6000; ++op) {
+            int k = rng() % key_count;
+            Record record{static_cast<int>(rng() % id_count), static_cast<int>(rng() % 1000)};
+            auto& values = versions[k];
+            switch (rng() % 4) {
+                case 0: {
+                    bool absent = !values.count(record.id);
+                    assert(bpt.insert_if_absent(key_of(k), record) == absent);
+                    if (absent) values[record.id] = record.version;
+                    break;
+                }
+                case 1: {
+                    bool absent = !values.count(record.id);
+                    assert(bpt.upsert(key_of(k), record) == absent);
+                    values[record.id] = record.version;
+                    break;
+                }
+                case 2: {
+                    // only erase stored versions that are even
+                    auto it = values.find(record.id);
+                    bool expected = it != values.end() && it->second % 2 == 0;
+                    assert(bpt.erase_if(key_of(k), record, [](const Record& stored) {
+                        return stored.version % 2 == 0;
+                    }) == expected);
+                    if (expected) values.erase(it);
+                    break;
+                }
+                default: {
+                    bool expected = values.erase(record.id) > 0;
+                    assert(bpt.erase(key_of(k), record) == expected);
+                }
+            }
+            if (op % 1500 == 0) {
+                verify(bpt, versions, key_count, "during session");
+            }
+        }
+        verify(bpt, versions, key_count, "end of session");
+        bpt.check_structure();
+    }
+    std::remove(db_filename.c_str());
+    std::cout << "--- Conditional writes passed ---" << std::endl;
+}
+
+void test_repeated_ingest() {
+    std::cout << "--- Idempotent ingest ---" << std::endl;
+    const std::string db_filename = "conditional_ingest.dat";
+    std::remove(db_filename.c_str());
+    {
+        Tree bpt(db_filename);
+        // the same batch arrives three times, only the first delivery stores anything
+        for (int round = 0; round < 3; ++round) {
+            int inserted = 0;
+            for (int i = 0; i < 2000; ++i) {
+                inserted += bpt.insert_if_absent(key_of(i % 100), Record{i, round});
+            }
+            assert(inserted == (round == 0 ? 2000 : 0));
+        }
+        for (int k = 0; k < 100; ++k) {
+            auto found = bpt.find(key_of(k));
+            assert(found.size() == 20);
+            for (size_t i = 0; i < found.size(); ++i) assert(found[i].version == 0);
+        }
+        bpt.check_structure();
+    }
+    std::remove(db_filename.c_str());
+    std::cout << "--- Idempotent ingest passed ---" << std::endl;
+}
+
+void test_modify_key() {
+    std::cout << "--- Writes decided by the values of a key ---" << std::endl;
+    const std::string db_filename = "conditional_modify_key.dat";
+    std::remove(db_filename.c_str());
+    const int key_count = 20;
+    Versions versions;
+    std::mt19937 rng(445566);
+    for (int session = 0; session < 2; ++session) {
+        Tree bpt(db_filename);
+        for (int op = 0; op < 5000; ++op) {
+            int k = rng() % key_count;
+            Record record{static_cast<int>(rng() % 60), static_cast<int>(rng() % 1000)};
+            auto& values = versions[k];
+            bool erasing = rng() % 3 == 0;
+            // a key keeps up to 30 values, more than a leaf holds, so that they span leaves
+            bool put = !erasing && values.size() < 30 && !values.count(record.id);
+            auto action = bpt.modify_key(key_of(k), record,
+                erasing ? Tree::OperationType::DELETE : Tree::OperationType::INSERT,
+                [&](const Record* last, size_t count) {
+                    assert(count == values.size());
+                    assert((last == nullptr) == values.empty());
+                    if (last != nullptr) {
+                        // the highest hash is the highest id
+                        assert(last->id == values.rbegin()->first && last->version == values.rbegin()->second);
+                    }
+                    return erasing ? Tree::WriteAction::ERASE : put ? Tree::WriteAction::PUT : Tree::WriteAction::KEEP;
+                });
+            if (erasing) {
+                bool expected = values.erase(record.id) > 0;
+                assert((action == Tree::WriteAction::ERASE) == expected);
+            } else {
+                assert((action == Tree::WriteAction::PUT) == put);
+                if (put) values[record.id] = record.version;
+            }
+        }
+        verify(bpt, versions, key_count, "end of session");
+        bpt.check_structure();
+    }
+    std::remove(db_filename.c_str());
+    std::cout << "--- Writes decided by the values of a key passed ---" << std::endl;
+}
+
+int main() {
+    test_random_against_reference();
+    test_repeated_ingest();
+    test_modify_key();
+    std::cout << "All conditional write tests passed." << std::endl;
+    return 0;
+}
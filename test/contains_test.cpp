@@ -0,0 +1,53 @@
+#include <algorithm>
+
+#define BPT_SMALL_SIZE
+#define BPT_TEST
+
+#include "src/BPT.h"
+#include "test/reference.h"
+
+RFlowey::string<64> key_of(int id) {
+    return RFlowey::string<64>("contains_" + std::to_string(id));
+}
+
+const int value_count = 40;
+
+template<typename Tree>
+void verify_lookups(Tree& bpt, const Reference& reference, int key_count, const char* stage) {
+    for (int id = 0; id < 2 * key_count; ++id) {
+        std::vector<int> expected = expected_of(reference, id);
+        bool ok = bpt.contains(key_of(id)) == !expected.empty() && bpt.count(key_of(id)) == expected.size();
+        for (size_t limit : {0, 1, 2, 7}) {
+            std::vector<int> prefix(expected.begin(), expected.begin() + std::min(limit, expected.size()));
+            ok = ok && values_of(bpt.find(key_of(id), limit)) == prefix;
+        }
+        for (int value = id * value_count; value < (id + 1) * value_count; ++value) {
+            bool present = std::find(expected.begin(), expected.end(), value) != expected.end();
+            ok = ok && bpt.contains(key_of(id), value) == present;
+        }
+        if (!ok) {
+            fail_mismatch(id, stage);
+        }
+    }
+}
+
+template<typename KeyHash>
+void test_random_against_reference(const std::string& db_filename) {
+    using Tree = RFlowey::BPT<RFlowey::string<64>, int, KeyHash, IntHasher>;
+    // values differ across keys, keys of one hash never share a tree key
+    Workload workload{.sessions = 2, .value_count = value_count, .distinct_values = true, .verify_span = 2};
+    run_sessions<Tree>(db_filename, workload, 97531, key_of, [&](Tree& bpt, const Reference& reference) {
+        verify_lookups(bpt, reference, workload.key_count, "end of session");
+    });
+}
+
+int main() {
+    std::cout << "--- contains, count and find with a limit ---" << std::endl;
+    test_random_against_reference<String64Hasher>("contains.dat");
+    std::cout << "--- Distinct hashes passed ---" << std::endl;
+    // few distinct hashes, so that the values of many keys are interleaved in one run of leaves
+    test_random_against_reference<CollidingHasher<3>>("contains_colliding.dat");
+    std::cout << "--- Shared hashes passed ---" << std::endl;
+    std::cout << "All contains tests passed." << std::endl;
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include <algorithm>
+
+#define BPT_SMALL_SIZE
+#define BPT_TEST
+
+#include "src/BPT.h"
+#include "test/reference.h"
+
+using Tree = RFlowey::BPT<int, int, OrderedHasher, IntHasher>;
+using Leaf = RFlowey::BPTNode<RFlowey::pair<RFlowey::hash_t, RFlowey::hash_t>, RFlowey::pair<int, int>, RFlowey::Leaf>;
+
+// keys are their own ids
+int key_of(int k) {
+    return k;
+}
+
+void verify_tree(Tree& bpt, const Reference& reference, int key_count, const char* stage) {
+    verify(bpt, reference, key_of, key_count, stage);
+    assert(bpt.check_structure() > Leaf::MERGE_T);
+}
+
+size_t reference_erase(Reference& reference, int lower, int upper) {
+    size_t erased = 0;
+    for (auto it = reference.lower_bound(lower); it != reference.end() && it->first < upper;) {
+        erased += it->second.size();
+        it = reference.erase(it);
+    }
+    return erased;
+}
+
+void test_random_against_reference() {
+    std::cout << "--- erase_all and erase_range against a reference ---" << std::endl;
+    const std::string db_filename = "erase_range.dat";
+    std::remove(db_filename.c_str());
+    const int key_count = 300;
+    Reference reference;
+    std::mt19937 rng(424242);
+    for (int session = 0; session < 3; ++session) {
+        Tree bpt(db_filename);
+        verify_tree(bpt, reference, key_count, "reopen");
+        for (int round = 0; round < 20; ++round) {
+            // a few keys get many values, spanning several leaves
+            for (int op = 0; op < 600; ++op) {
+                int k = rng() % 10 == 0 ? static_cast<int>(rng() % 5) : static_cast<int>(rng() % key_count);
+                int value = k * 1000 + static_cast<int>(rng() % 1000);
+                if (reference[k].insert(value).second) {
+                    bpt.insert(k, value);
+                }
+            }
+            int k = rng() % key_count;
+            size_t expected = reference.count(k) ? reference[k].size() : 0;
+            reference.erase(k);
+            assert(bpt.erase_all(k) == expected);
+            assert(bpt.erase_all(k) == 0);
+            int lower = rng() % key_count;
+            int upper = lower + static_cast<int>(rng() % 40);
+            expected = reference_erase(reference, lower, upper);
+            assert(bpt.erase_range(OrderedHasher{}(lower), OrderedHasher{}(upper)) == expected);
+            verify_tree(bpt, reference, key_count, "after bulk erase");
+            // empty and inverted ranges erase nothing
+            k = rng() % key_count;
+            assert(bpt.erase_range(OrderedHasher{}(k), OrderedHasher{}(k)) == 0);
+            assert(bpt.erase_range(OrderedHasher{}(k) + 1, OrderedHasher{}(k)) == 0);
+            verify_tree(bpt, reference, key_count, "after empty ranges");
+        }
+    }
+    {
+        // everything from a hash on, with an open upper end
+        Tree bpt(db_filename);
+        size_t expected = reference_erase(reference, key_count / 2, key_count);
+        assert(bpt.erase_range(OrderedHasher{}(key_count / 2)) == expected);
+        verify_tree(bpt, reference, key_count, "after open range");
+        expected = reference_erase(reference, 0, key_count);
+        assert(bpt.erase_range(0) == expected);
+        verify_tree(bpt, reference, key_count, "after erasing everything");
+        // in random order, ascending inserts would leave the rightmost leaves nearly empty on purpose
+        std::vector<int> keys(50);
+        for (int k = 0; k < 50; ++k) keys[k] = k;
+        std::shuffle(keys.begin(), keys.end(), rng);
+        for (int k : keys) {
+            bpt.insert(k, k);
+            reference[k].insert(k);
+        }
+        verify_tree(bpt, reference, key_count, "after refilling");
+    }
+    std::remove(db_filename.c_str());
+    std::cout << "--- Bulk erase passed ---" << std::endl;
+}
+
+int main() {
+    test_random_against_reference();
+    std::cout << "All erase range tests passed." << std::endl;
+    return 0;
+}
@@ -0,0 +1,119 @@
+#include <iostream>
+#include <string>
+#include <cassert>
+#include <cstdio>
+#include <iterator>
+#include <map>
+#include <set>
+#include <random>
+#include <vector>
+
+#define BPT_SMALL_SIZE
+#define BPT_TEST
+
+#include "src/BPT.h"
+
+struct String64Hasher {
+    RFlowey::hash_t operator()(const RFlowey::string<64>& s) const {
+        return RFlowey::hash(s);
+    }
+};
+
+struct IntHasher {
+    RFlowey::hash_t operator()(const int& v) const {
+        return static_cast<RFlowey::hash_t>(static_cast<long long>(v)-std::numeric_limits<int>::min());
+    }
+};
+
+using Tree = RFlowey::BPT<RFlowey::string<64>, int, String64Hasher, IntHasher>;
+using Reference = std::map<std::string, std::set<int>>;
+
+RFlowey::string<64> key_of(int id) {
+    return RFlowey::string<64>("each_" + std::to_string(id));
+}
+
+void test_find_variants_agree() {
+    std::cout << "--- find, find_each, find(key, out) and find_into agree ---" << std::endl;
+    const std::string db_filename = "find_each.dat";
+    std::remove(db_filename.c_str());
+    const int key_count = 200;
+    Reference reference;
+    std::mt19937 rng(2468);
+    Tree bpt(db_filename);
+    for (int op = 0; op < 6000; ++op) {
+        int id = rng() % key_count;
+        // a few keys get many values, spanning several leaves
+        int value = id < 5 ? static_cast<int>(rng() % 400) : static_cast<int>(rng() % 6);
+        std::string key = "each_" + std::to_string(id);
+        if (rng() % 4 != 0) {
+            if (reference[key].insert(value).second) {
+                bpt.insert(key_of(id), value);
+            }
+        } else {
+            reference[key].erase(value);
+            bpt.erase(key_of(id), value);
+        }
+    }
+    std::vector<int> buffer;
+    for (int id = 0; id < 2 * key_count; ++id) {
+        std::vector<int> expected;
+        auto it = reference.find("each_" + std::to_string(id));
+        if (it != reference.end()) {
+            expected.assign(it->second.begin(), it->second.end());
+        }
+        auto found = bpt.find(key_of(id));
+        std::vector<int> from_find;
+        for (size_t i = 0; i < found.size(); ++i) from_find.push_back(found[i]);
+        assert(from_find == expected);
+
+        std::vector<int> from_each;
+        bpt.find_each(key_of(id), [&](const int& value) { from_each.push_back(value); });
+        assert(from_each == expected);
+
+        std::vector<int> from_iterator;
+        bpt.find(key_of(id), std::back_inserter(from_iterator));
+        assert(from_iterator == expected);
+
+        int array[512];
+        int* end = bpt.find(key_of(id), array);
+        assert(std::vector<int>(array, end) == expected);
+
+        assert(bpt.find_into(key_of(id), buffer) == expected.size());
+        assert(buffer == expected);
+    }
+    std::remove(db_filename.c_str());
+    std::cout << "--- find variants passed ---" << std::endl;
+}
+
+void test_find_into_reuses_storage() {
+    std::cout << "--- find_into reuses the buffer ---" << std::endl;
+    const std::string db_filename = "find_into.dat";
+    std::remove(db_filename.c_str());
+    {
+        Tree bpt(db_filename);
+        for (int value = 0; value < 100; ++value) bpt.insert(key_of(1), value);
+        for (int value = 0; value < 10; ++value) bpt.insert(key_of(2), value);
+        std::vector<int> buffer;
+        assert(bpt.find_into(key_of(1), buffer) == 100);
+        const int* storage = buffer.data();
+        size_t capacity = buffer.capacity();
+        assert(bpt.find_into(key_of(2), buffer) == 10);
+        assert(buffer.data() == storage && buffer.capacity() == capacity);
+        assert(bpt.find_into(key_of(3), buffer) == 0);
+        assert(buffer.data() == storage && buffer.capacity() == capacity);
+        // the caller's own container type works as well
+        sjtu::vector<int> other;
+        other.push_back(-1);
+        assert(bpt.find_into(key_of(2), other) == 10);
+        for (int value = 0; value < 10; ++value) assert(other[value] == value);
+    }
+    std::remove(db_filename.c_str());
+    std::cout << "--- find_into passed ---" << std::endl;
+}
+
+int main() {
+    test_find_variants_agree();
+    test_find_into_reuses_storage();
+    std::cout << "All find_each tests passed." << std::endl;
+    return 0;
+}
@@ -0,0 +1,63 @@
+#define BPT_SMALL_SIZE
+#define BPT_TEST
+
+#include "src/BPT.h"
+#include "test/reference.h"
+
+// OrderedHasher: a run of neighbouring keys is a run of neighbouring leaves
+using Tree = RFlowey::BPT<int, int, OrderedHasher, IntHasher>;
+
+int key_of(int k) {
+    return k;
+}
+
+void test_runs_and_jumps() {
+    std::cout << "--- Runs of neighbouring keys mixed with jumps ---" << std::endl;
+    const std::string db_filename = "finger.dat";
+    std::remove(db_filename.c_str());
+    const int key_count = 3000;
+    Reference reference;
+    std::mt19937 rng(97);
+    for (int session = 0; session < 2; ++session) {
+        Tree bpt(db_filename);
+        for (int round = 0; round < 200; ++round) {
+            // a run of mixed operations, going up or down from a random key, then a jump
+            // somewhere else; the runs split and merge the leaves the last descent went through
+            int k = rng() % key_count;
+            int step = rng() % 2 ? 1 : -1;
+            int length = 1 + rng() % 60;
+            for (int i = 0; i < length; ++i, k += step) {
+                int op = rng() % 3;
+                if (k < 0 || k >= key_count) {
+                    break;
+                }
+                int value = k * 100 + static_cast<int>(rng() % 100);
+                if (op == 0) {
+                    if (reference[k].insert(value).second) {
+                        bpt.insert(k, value);
+                    }
+                } else if (op == 1) {
+                    auto& values = reference[k];
+                    if (!values.empty()) {
+                        int victim = *values.begin();
+                        values.erase(values.begin());
+                        assert(bpt.erase(k, victim));
+                    }
+                } else {
+                    check(bpt, reference, key_of, k, "run");
+                }
+            }
+            check(bpt, reference, key_of, rng() % key_count, "jump");
+        }
+        verify(bpt, reference, key_of, key_count, "end of session");
+        bpt.check_structure();
+    }
+    std::remove(db_filename.c_str());
+    std::cout << "--- Runs and jumps passed ---" << std::endl;
+}
+
+int main() {
+    test_runs_and_jumps();
+    std::cout << "All finger tests passed." << std::endl;
+    return 0;
+}
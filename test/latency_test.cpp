@@ -0,0 +1,109 @@
+#include <iostream>
+#include <string>
+#include <cassert>
+#include <cstdio>
+#include <iomanip>
+#include <sstream>
+
+#define BPT_SMALL_SIZE
+#define BPT_LATENCY_STATS
+
+#include "src/BPT.h"
+#include "src/utils/latency.h"
+
+struct String64Hasher {
+    RFlowey::hash_t operator()(const RFlowey::string<64>& s) const {
+        return RFlowey::hash(s);
+    }
+};
+
+struct IntHasher {
+    RFlowey::hash_t operator()(const int& v) const {
+        return static_cast<RFlowey::hash_t>(static_cast<long long>(v)-std::numeric_limits<int>::min());
+    }
+};
+
+// a quantile must land within the relative error of its bucket (1/16)
+bool close_to(uint64_t got, uint64_t expected) {
+    return got >= expected && got <= expected + expected / 16 + 1;
+}
+
+void test_histogram_percentiles() {
+    std::cout << "--- Histogram percentiles ---" << std::endl;
+    RFlowey::LatencyHistogram h;
+    assert(h.count() == 0 && h.p50() == 0 && h.max() == 0);
+
+    for (uint64_t v = 1; v <= 100000; ++v) {
+        h.record(v);
+    }
+    assert(h.count() == 100000);
+    assert(h.min() == 1 && h.max() == 100000);
+    assert(close_to(h.p50(), 50000));
+    assert(close_to(h.p99(), 99000));
+    assert(close_to(h.p999(), 99900));
+    assert(h.percentile(1.0) == 100000);
+
+    // small values are exact
+    RFlowey::LatencyHistogram small;
+    for (int i = 0; i < 10; ++i) small.record(7);
+    small.record(3);
+    assert(small.p50() == 7 && small.percentile(0.01) == 3);
+
+    // nearest rank: the median of three samples is the second
+    RFlowey::LatencyHistogram three;
+    for (uint64_t v = 1; v <= 3; ++v) three.record(v);
+    assert(three.p50() == 2 && three.percentile(1.0 / 3) == 1 && three.percentile(0.34) == 2);
+
+    // a single outlier shows up in the tail only
+    RFlowey::LatencyHistogram tail;
+    for (int i = 0; i < 999; ++i) tail.record(1000);
+    tail.record(5000000);
+    assert(close_to(tail.p99(), 1000));
+    assert(close_to(tail.percentile(1.0), 5000000));
+
+    h.merge(tail);
+    assert(h.count() == 101000 && h.max() == 5000000);
+    h.reset();
+    assert(h.count() == 0);
+    std::cout << "--- Histogram percentiles passed ---" << std::endl;
+}
+
+void test_bpt_records_operations() {
+    std::cout << "--- BPT latency recording ---" << std::endl;
+    const std::string db_filename = "latency_test.dat";
+    std::remove(db_filename.c_str());
+    {
+        RFlowey::BPT<RFlowey::string<64>, int, String64Hasher, IntHasher> bpt(db_filename);
+        for (int i = 0; i < 200; ++i) {
+            bpt.insert(RFlowey::string<64>("key" + std::to_string(i % 20)), i);
+        }
+        for (int i = 0; i < 50; ++i) {
+            bpt.find(RFlowey::string<64>("key" + std::to_string(i)));
+        }
+        for (int i = 0; i < 30; ++i) {
+            bpt.erase(RFlowey::string<64>("key" + std::to_string(i % 20)), i);
+        }
+        assert(bpt.insert_latency().count() == 200);
+        assert(bpt.find_latency().count() == 50);
+        assert(bpt.erase_latency().count() == 30);
+        assert(bpt.insert_latency().p50() <= bpt.insert_latency().p999());
+
+        std::ostringstream os;
+        os << std::scientific << std::setprecision(5);
+        bpt.dump_latency(os);
+        assert(os.str().find("insert") != std::string::npos);
+        assert(os.str().find("p999=") != std::string::npos);
+        // the caller's formatting survives the dump
+        assert((os.flags() & std::ios_base::floatfield) == std::ios_base::scientific && os.precision() == 5);
+        std::cout << os.str();
+    }
+    std::remove(db_filename.c_str());
+    std::cout << "--- BPT latency recording passed ---" << std::endl;
+}
+
+int main() {
+    test_histogram_percentiles();
+    test_bpt_records_operations();
+    std::cout << "All latency tests passed." << std::endl;
+    return 0;
+}
@@ -0,0 +1,73 @@
+#include <algorithm>
+
+#define BPT_SMALL_SIZE
+#define BPT_TEST
+#define BPT_LAZY_REBALANCE
+
+#include "src/BPT.h"
+#include "test/reference.h"
+
+using Tree = RFlowey::BPT<RFlowey::string<64>, int, String64Hasher, IntHasher>;
+using Leaf = RFlowey::BPTNode<RFlowey::pair<RFlowey::hash_t, RFlowey::hash_t>, RFlowey::pair<RFlowey::string<64>, int>, RFlowey::Leaf>;
+
+RFlowey::string<64> key_of(int id) {
+    return RFlowey::string<64>("lazy_" + std::to_string(id));
+}
+
+void test_deferred_rebalance() {
+    std::cout << "--- Deferred rebalance ---" << std::endl;
+    const std::string db_filename = "lazy_rebalance.dat";
+    std::remove(db_filename.c_str());
+    const int n = 3000;
+    std::vector<int> ids(n);
+    for (int i = 0; i < n; ++i) ids[i] = i;
+    std::mt19937 rng(777);
+    std::shuffle(ids.begin(), ids.end(), rng);
+    Reference reference;
+    {
+        Tree bpt(db_filename);
+        for (int id : ids) {
+            bpt.insert(key_of(id), id);
+            reference[id].insert(id);
+        }
+        std::shuffle(ids.begin(), ids.end(), rng);
+        for (int i = 0; i < n * 9 / 10; ++i) {
+            assert(bpt.erase(key_of(ids[i]), ids[i]));
+            assert(!bpt.erase(key_of(ids[i]), ids[i]));
+            reference.erase(ids[i]);
+            if (i % 250 == 0) {
+                // underfull leaves may be waiting, lookups and inserts still see every entry
+                verify(bpt, reference, key_of, n, "while leaves are queued");
+                bpt.check_structure();
+            }
+        }
+        // flush runs the queued rebalancing
+        bpt.flush();
+        assert(bpt.check_structure() > Leaf::MERGE_T);
+        verify(bpt, reference, key_of, n, "after flush");
+        for (int i = n * 9 / 10; i < n; ++i) {
+            assert(bpt.erase(key_of(ids[i]), ids[i]));
+        }
+        reference.clear();
+    }
+    {
+        // the destructor ran the rest
+        Tree bpt(db_filename);
+        verify(bpt, reference, key_of, n, "after reopen");
+        for (int id = 0; id < 300; ++id) {
+            bpt.insert(key_of(id), id);
+            reference[id].insert(id);
+        }
+        bpt.flush();
+        assert(bpt.check_structure() > Leaf::MERGE_T);
+        verify(bpt, reference, key_of, n, "after refilling");
+    }
+    std::remove(db_filename.c_str());
+    std::cout << "--- Deferred rebalance passed ---" << std::endl;
+}
+
+int main() {
+    test_deferred_rebalance();
+    std::cout << "All lazy rebalance tests passed." << std::endl;
+    return 0;
+}
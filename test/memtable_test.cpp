@@ -0,0 +1,60 @@
+#define BPT_SMALL_SIZE
+#define BPT_TEST
+#define BPT_MEMTABLE
+
+#include "src/BPT.h"
+#include "test/reference.h"
+
+using Tree = RFlowey::BPT<RFlowey::string<64>, int, String64Hasher, IntHasher>;
+
+RFlowey::string<64> key_of(int id) {
+    return RFlowey::string<64>("key" + std::to_string(id));
+}
+
+void test_burst_stays_in_memory() {
+    std::cout << "--- Burst below the budget ---" << std::endl;
+    const std::string db_filename = "memtable_burst.dat";
+    std::remove(db_filename.c_str());
+    RFlowey::string<64> key("alpha");
+    {
+        Tree bpt(db_filename);
+        for (int i = 0; i < 10; ++i) {
+            bpt.insert(key, i);
+        }
+        assert(bpt.erase(key, 3));
+        assert(!bpt.erase(key, 3));
+        assert(!bpt.erase(key, 42));
+        auto found = bpt.find(key);
+        assert(found.size() == 9 && found[0] == 0 && found[3] == 4);
+        // drained by flush, erases of tree entries are buffered again
+        bpt.flush();
+        assert(bpt.erase(key, 0));
+        bpt.insert(key, 0);
+        assert(bpt.erase(key, 0));
+        assert(!bpt.erase(key, 0));
+        assert(bpt.find(key).size() == 8);
+    }
+    {
+        // the destructor drained the rest
+        Tree bpt(db_filename);
+        auto found = bpt.find(key);
+        assert(found.size() == 8 && found[0] == 1);
+    }
+    std::remove(db_filename.c_str());
+    std::cout << "--- Burst below the budget passed ---" << std::endl;
+}
+
+void test_random_against_reference() {
+    std::cout << "--- Random workload across sessions ---" << std::endl;
+    run_sessions<Tree>("memtable_random.dat",
+                       Workload{.sessions = 4, .value_base = -20, .verify_every = 500}, 20240612, key_of,
+                       [](Tree&, const Reference&) {});
+    std::cout << "--- Random workload across sessions passed ---" << std::endl;
+}
+
+int main() {
+    test_burst_stays_in_memory();
+    test_random_against_reference();
+    std::cout << "All memtable tests passed." << std::endl;
+    return 0;
+}
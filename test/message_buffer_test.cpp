@@ -0,0 +1,78 @@
+#define BPT_SMALL_SIZE
+#define BPT_TEST
+#define BPT_MESSAGE_BUFFER
+
+#include "src/BPT.h"
+#include "test/reference.h"
+
+using Tree = RFlowey::BPT<RFlowey::string<64>, int, String64Hasher, IntHasher>;
+
+RFlowey::string<64> key_of(int id) {
+    return RFlowey::string<64>("key" + std::to_string(id));
+}
+
+void test_messages_cancel_in_buffer() {
+    std::cout << "--- Cancel inside the buffer ---" << std::endl;
+    const std::string db_filename = "message_buffer_cancel.dat";
+    std::remove(db_filename.c_str());
+    {
+        Tree bpt(db_filename);
+        RFlowey::string<64> key("alpha");
+        assert(!bpt.erase(key, 1));
+        bpt.insert(key, 1);
+        bpt.insert(key, 3);
+        bpt.insert(key, 2);
+        auto found = bpt.find(key);
+        assert(found.size() == 3 && found[0] == 1 && found[1] == 2 && found[2] == 3);
+        assert(bpt.erase(key, 1));
+        assert(bpt.erase(key, 3));
+        assert(!bpt.erase(key, 1));
+        bpt.insert(key, 1);
+        found = bpt.find(key);
+        assert(found.size() == 2 && found[0] == 1 && found[1] == 2);
+    }
+    std::remove(db_filename.c_str());
+    std::cout << "--- Cancel inside the buffer passed ---" << std::endl;
+}
+
+void test_random_against_reference() {
+    std::cout << "--- Random workload across sessions ---" << std::endl;
+    // sessions end with a non-empty buffer, which must survive the reopen
+    run_sessions<Tree>("message_buffer_random.dat",
+                       Workload{.sessions = 4, .value_base = -20, .verify_every = 500}, 20240611, key_of,
+                       [](Tree&, const Reference&) {});
+    std::cout << "--- Random workload across sessions passed ---" << std::endl;
+}
+
+void test_sorted_ingest() {
+    std::cout << "--- Sorted and reversed ingest ---" << std::endl;
+    const std::string db_filename = "message_buffer_ingest.dat";
+    std::remove(db_filename.c_str());
+    Reference reference;
+    {
+        Tree bpt(db_filename);
+        for (int i = 0; i < 2000; ++i) {
+            bpt.insert(key_of(i % 100), i);
+            reference[i % 100].insert(i);
+        }
+        for (int i = 1999; i >= 0; i -= 3) {
+            assert(bpt.erase(key_of(i % 100), i));
+            reference[i % 100].erase(i);
+        }
+        verify(bpt, reference, key_of, 100, "after ingest");
+    }
+    {
+        Tree bpt(db_filename);
+        verify(bpt, reference, key_of, 100, "after reopen");
+    }
+    std::remove(db_filename.c_str());
+    std::cout << "--- Sorted and reversed ingest passed ---" << std::endl;
+}
+
+int main() {
+    test_messages_cancel_in_buffer();
+    test_random_against_reference();
+    test_sorted_ingest();
+    std::cout << "All message buffer tests passed." << std::endl;
+    return 0;
+}
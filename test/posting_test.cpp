@@ -0,0 +1,199 @@
+#include <iostream>
+#include <string>
+#include <cassert>
+#include <cstdio>
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <set>
+#include <random>
+#include <vector>
+
+#define BPT_SMALL_SIZE
+#define BPT_TEST
+
+#include "src/posting.h"
+
+struct String64Hasher {
+    RFlowey::hash_t operator()(const RFlowey::string<64>& s) const {
+        return RFlowey::hash(s);
+    }
+};
+
+struct IntHasher {
+    RFlowey::hash_t operator()(const int& v) const {
+        return static_cast<RFlowey::hash_t>(static_cast<long long>(v)-std::numeric_limits<int>::min());
+    }
+};
+
+// eight values to a hash, and negative values on the hash the tree keeps for posting lists
+struct BucketHasher {
+    RFlowey::hash_t operator()(const int& v) const {
+        return v < 0 ? std::numeric_limits<RFlowey::hash_t>::max() : static_cast<RFlowey::hash_t>(v / 8);
+    }
+};
+
+using Tree = RFlowey::PostingBPT<RFlowey::string<64>, int, String64Hasher, IntHasher>;
+// like the driver's workload, a (key, value) pair is never inserted twice
+using Reference = std::map<std::string, std::set<int>>;
+
+void verify(Tree& bpt, const Reference& reference, int key_count, const char* stage) {
+    for (int k = 0; k < key_count; ++k) {
+        std::string key = "key" + std::to_string(k);
+        std::vector<int> expected;
+        auto it = reference.find(key);
+        if (it != reference.end()) {
+            expected.assign(it->second.begin(), it->second.end());
+        }
+        auto found = bpt.find(RFlowey::string<64>(key));
+        std::vector<int> got;
+        for (size_t i = 0; i < found.size(); ++i) got.push_back(found[i]);
+        if (got != expected) {
+            std::cerr << "Mismatch for " << key << " at " << stage << ": expected " << expected.size()
+                      << " values, got " << got.size() << std::endl;
+            assert(false);
+        }
+    }
+}
+
+void test_list_lifecycle() {
+    std::cout << "--- Posting list lifecycle ---" << std::endl;
+    const std::string db_filename = "posting_lifecycle.dat";
+    std::remove(db_filename.c_str());
+    RFlowey::string<64> hot("hot"), cold("cold");
+    const int count = 500;
+    {
+        Tree bpt(db_filename);
+        bpt.insert(cold, 7);
+        // descending values exercise inserts at the front of the list
+        for (int i = count - 1; i >= 0; --i) {
+            bpt.insert(hot, i * 2);
+        }
+        auto found = bpt.find(hot);
+        assert(found.size() == count);
+        for (int i = 0; i < count; ++i) assert(found[i] == i * 2);
+        assert(!bpt.erase(hot, 1));
+        assert(!bpt.erase(hot, count * 2));
+    }
+    {
+        Tree bpt(db_filename);
+        assert(bpt.find(hot).size() == count);
+        for (int i = 0; i < count; ++i) {
+            assert(bpt.erase(hot, i * 2));
+        }
+        assert(bpt.find(hot).empty());
+        assert(!bpt.erase(hot, 0));
+        // an emptied key starts over with inline values
+        bpt.insert(hot, 3);
+        bpt.insert(hot, 1);
+        auto found = bpt.find(hot);
+        assert(found.size() == 2 && found[0] == 1 && found[1] == 3);
+        found = bpt.find(cold);
+        assert(found.size() == 1 && found[0] == 7);
+    }
+    std::remove(db_filename.c_str());
+    std::cout << "--- Posting list lifecycle passed ---" << std::endl;
+}
+
+void test_random_against_reference() {
+    std::cout << "--- Random workload across sessions ---" << std::endl;
+    const std::string db_filename = "posting_random.dat";
+    std::remove(db_filename.c_str());
+    const int key_count = 40;
+    Reference reference;
+    std::mt19937 rng(20240612);
+    for (int session = 0; session < 4; ++session) {
+        Tree bpt(db_filename);
+        verify(bpt, reference, key_count, "reopen");
+        for (int op = 0; op < 6000; ++op) {
+            // a few hot keys get most of the values
+            int k = rng() % 4 == 0 ? static_cast<int>(rng() % key_count) : static_cast<int>(rng() % 3);
+            std::string key = "key" + std::to_string(k);
+            int value = static_cast<int>(rng() % 400) - 200;
+            if (rng() % 3 != 0) {
+                if (reference[key].insert(value).second) {
+                    bpt.insert(RFlowey::string<64>(key), value);
+                }
+            } else {
+                bool expected = reference[key].erase(value) > 0;
+                assert(bpt.erase(RFlowey::string<64>(key), value) == expected);
+            }
+            if (op % 1000 == 0) {
+                verify(bpt, reference, key_count, "during session");
+            }
+        }
+        verify(bpt, reference, key_count, "end of session");
+    }
+    std::remove(db_filename.c_str());
+    std::cout << "--- Random workload across sessions passed ---" << std::endl;
+}
+
+void test_colliding_values() {
+    std::cout << "--- Values sharing a hash ---" << std::endl;
+    const std::string db_filename = "posting_colliding.dat";
+    std::remove(db_filename.c_str());
+    using BucketTree = RFlowey::PostingBPT<RFlowey::string<64>, int, String64Hasher, BucketHasher>;
+    BucketHasher bucket;
+    RFlowey::string<64> hot("hot"), few("few");
+    // inline values of one key have distinct hashes, so the list starts from one value per hash
+    std::vector<int> values = {-1};
+    for (int i = 0; i < 400; i += 8) values.push_back(i);
+    std::mt19937 rng(7);
+    std::vector<int> rest = {-3, -2};
+    for (int i = 0; i < 400; ++i) {
+        if (i % 8 != 0) rest.push_back(i);
+    }
+    std::shuffle(rest.begin(), rest.end(), rng);
+    values.insert(values.end(), rest.begin(), rest.end());
+    // remaining values per hash; erase takes any value of the hash
+    std::map<RFlowey::hash_t, int> remaining;
+    {
+        BucketTree bpt(db_filename);
+        bpt.insert(few, -1);
+        bpt.insert(few, 5);
+        for (int v : values) {
+            bpt.insert(hot, v);
+            ++remaining[bucket(v)];
+        }
+        assert(bpt.find(hot).size() == values.size());
+        auto found = bpt.find(few);
+        assert(found.size() == 2 && found[0] == 5 && found[1] == -1);
+    }
+    {
+        BucketTree bpt(db_filename);
+        std::shuffle(values.begin(), values.end(), rng);
+        size_t left = values.size();
+        for (int v : values) {
+            // the lists of the hashes erased so far must report them gone
+            assert(bpt.erase(hot, v) == (remaining[bucket(v)] > 0));
+            --remaining[bucket(v)];
+            --left;
+            if (left % 50 == 0) {
+                auto found = bpt.find(hot);
+                assert(found.size() == left);
+                std::map<RFlowey::hash_t, int> counted;
+                for (size_t i = 0; i < found.size(); ++i) ++counted[bucket(found[i])];
+                for (const auto& [hash, count] : counted) assert(remaining[hash] == count);
+            }
+        }
+        assert(bpt.find(hot).empty());
+        assert(!bpt.erase(hot, 0));
+        assert(!bpt.erase(hot, -1));
+        // the emptied list is gone from the tree, the key starts over inline
+        bpt.insert(hot, 9);
+        auto found = bpt.find(hot);
+        assert(found.size() == 1 && found[0] == 9);
+        assert(bpt.erase(few, -2));
+        assert(bpt.find(few).size() == 1);
+    }
+    std::remove(db_filename.c_str());
+    std::cout << "--- Values sharing a hash passed ---" << std::endl;
+}
+
+int main() {
+    test_list_lifecycle();
+    test_colliding_values();
+    test_random_against_reference();
+    std::cout << "All posting list tests passed." << std::endl;
+    return 0;
+}
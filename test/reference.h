@@ -0,0 +1,169 @@
+#ifndef TEST_REFERENCE_H
+#define TEST_REFERENCE_H
+
+// The model the randomized tests check a tree against, the values each key id should have,
+// with the hashers, checks and session workload they share. Included after the BPT_ defines.
+
+#include <iostream>
+#include <string>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <set>
+#include <random>
+#include <vector>
+
+#include "src/BPT.h"
+
+struct String64Hasher {
+    RFlowey::hash_t operator()(const RFlowey::string<64>& s) const {
+        return RFlowey::hash(s);
+    }
+};
+
+// BUCKETS distinct hashes, so that keys share hashes and the values of many keys are interleaved in one run of leaves
+template<RFlowey::hash_t BUCKETS>
+struct CollidingHasher {
+    RFlowey::hash_t operator()(const RFlowey::string<64>& s) const {
+        return RFlowey::hash(s) % BUCKETS + 1;
+    }
+};
+
+// int keys hash to their own order, so that a hash range is a range of keys and neighbouring keys share leaves
+struct OrderedHasher {
+    RFlowey::hash_t operator()(const int& k) const {
+        return static_cast<RFlowey::hash_t>(k) + 1;
+    }
+};
+
+struct IntHasher {
+    RFlowey::hash_t operator()(const int& v) const {
+        return static_cast<RFlowey::hash_t>(static_cast<long long>(v)-std::numeric_limits<int>::min());
+    }
+};
+
+// key id -> values; like the driver's workload, a (key, value) pair is never inserted twice
+using Reference = std::map<int, std::set<int>>;
+
+inline std::vector<int> expected_of(const Reference& reference, int id) {
+    auto it = reference.find(id);
+    if (it == reference.end()) {
+        return {};
+    }
+    return {it->second.begin(), it->second.end()};
+}
+
+/**
+ * @return the values of a find result, in its order
+ */
+template<typename Found>
+std::vector<int> values_of(const Found& found) {
+    std::vector<int> values;
+    for (size_t i = 0; i < found.size(); ++i) values.push_back(found[i]);
+    return values;
+}
+
+inline void fail_mismatch(int id, const char* stage) {
+    std::cerr << "Mismatch for id " << id << " at " << stage << std::endl;
+    assert(false);
+}
+
+template<typename T>
+void expect_same(int id, const std::vector<T>& expected, const std::vector<T>& got, const char* stage) {
+    if (got == expected) {
+        return;
+    }
+    if constexpr (requires(const T& v) { std::cerr << v; }) {
+        std::cerr << "expected";
+        for (const T& v : expected) std::cerr << ' ' << v;
+        std::cerr << ", got";
+        for (const T& v : got) std::cerr << ' ' << v;
+        std::cerr << std::endl;
+    }
+    fail_mismatch(id, stage);
+}
+
+/**
+ * @brief check bpt.find(key_of(id)) against the reference
+ */
+template<typename Tree, typename KeyOf>
+void check(Tree& bpt, const Reference& reference, KeyOf&& key_of, int id, const char* stage) {
+    expect_same(id, expected_of(reference, id), values_of(bpt.find(key_of(id))), stage);
+}
+
+/**
+ * @brief check every id in [0, id_count)
+ */
+template<typename Tree, typename KeyOf>
+void verify(Tree& bpt, const Reference& reference, KeyOf&& key_of, int id_count, const char* stage) {
+    for (int id = 0; id < id_count; ++id) {
+        check(bpt, reference, key_of, id, stage);
+    }
+}
+
+/**
+ * @brief insert (id, value) unless the reference has it already, or erase it and expect the tree
+ * to have had it exactly if the reference had
+ */
+template<typename Tree, typename KeyOf>
+void apply_write(Tree& bpt, Reference& reference, KeyOf&& key_of, int id, int value, bool erase) {
+    if (!erase) {
+        if (reference[id].insert(value).second) {
+            bpt.insert(key_of(id), value);
+        }
+        return;
+    }
+    bool expected = reference[id].erase(value) > 0;
+    assert(bpt.erase(key_of(id), value) == expected);
+}
+
+// the shape of run_sessions
+struct Workload {
+    int sessions = 3;
+    int ops = 3000;
+    // ids are drawn from [0, key_count) and values from [value_base, value_base + value_count);
+    // with distinct_values the values of id start at id * value_count, so keys never share a value
+    int key_count = 60;
+    int value_count = 40;
+    int value_base = 0;
+    bool distinct_values = false;
+    // one write in erase_one_in is an erase, which may miss
+    int erase_one_in = 3;
+    // also verify every verify_every ops, never if 0
+    int verify_every = 0;
+    // verify the ids below verify_span * key_count, the ones from key_count on are never inserted
+    int verify_span = 1;
+};
+
+/**
+ * @brief the random workload across sessions: every session reopens db_filename, verifies what the
+ * sessions before left, runs random writes against the reference and verifies again, then calls
+ * end_session(bpt, reference). The file is removed before and after.
+ */
+template<typename Tree, typename KeyOf, typename EndSession>
+void run_sessions(const std::string& db_filename, const Workload& workload, uint32_t seed, KeyOf&& key_of,
+                  EndSession&& end_session) {
+    std::remove(db_filename.c_str());
+    Reference reference;
+    std::mt19937 rng(seed);
+    int id_count = workload.verify_span * workload.key_count;
+    for (int session = 0; session < workload.sessions; ++session) {
+        Tree bpt(db_filename);
+        verify(bpt, reference, key_of, id_count, "reopen");
+        for (int op = 0; op < workload.ops; ++op) {
+            int id = rng() % workload.key_count;
+            int base = workload.distinct_values ? id * workload.value_count : workload.value_base;
+            int value = base + static_cast<int>(rng() % workload.value_count);
+            apply_write(bpt, reference, key_of, id, value, rng() % workload.erase_one_in == 0);
+            if (workload.verify_every != 0 && op % workload.verify_every == 0) {
+                verify(bpt, reference, key_of, id_count, "during session");
+            }
+        }
+        verify(bpt, reference, key_of, id_count, "end of session");
+        end_session(bpt, reference);
+    }
+    std::remove(db_filename.c_str());
+}
+
+#endif //TEST_REFERENCE_H
@@ -0,0 +1,54 @@
+#define BPT_SMALL_SIZE
+#define BPT_TEST
+#define BPT_RESULT_CACHE
+
+#include "src/BPT.h"
+#include "test/reference.h"
+
+RFlowey::string<64> key_of(int id) {
+    return RFlowey::string<64>("cache_" + std::to_string(id));
+}
+
+template<typename KeyHash>
+void test_skewed_workload(const std::string& db_filename) {
+    using Tree = RFlowey::BPT<RFlowey::string<64>, int, KeyHash, IntHasher>;
+    std::remove(db_filename.c_str());
+    const int key_count = 500;
+    Reference reference;
+    std::mt19937 rng(8642);
+    // most operations go to a few hot keys, the rest spread over the others
+    auto pick = [&]() {
+        return rng() % 4 != 0 ? static_cast<int>(rng() % 8) : static_cast<int>(rng() % key_count);
+    };
+    for (int session = 0; session < 2; ++session) {
+        Tree bpt(db_filename);
+        for (int op = 0; op < 20000; ++op) {
+            int id = pick();
+            // values differ across keys, keys of one hash never share a tree key
+            int value = id * 16 + static_cast<int>(rng() % 16);
+            switch (rng() % 6) {
+                case 0:
+                case 1:
+                    apply_write(bpt, reference, key_of, id, value, rng() % 2 == 0);
+                    break;
+                default:
+                    // repeated finds of a key are served from the cache
+                    check(bpt, reference, key_of, id, "find");
+            }
+        }
+        verify(bpt, reference, key_of, key_count, "end of session");
+    }
+    std::remove(db_filename.c_str());
+}
+
+int main() {
+    std::cout << "--- Skewed workload ---" << std::endl;
+    test_skewed_workload<String64Hasher>("result_cache.dat");
+    std::cout << "--- Skewed workload passed ---" << std::endl;
+    std::cout << "--- Keys sharing hashes ---" << std::endl;
+    // few distinct hashes, so that keys share cache slots
+    test_skewed_workload<CollidingHasher<7>>("result_cache_colliding.dat");
+    std::cout << "--- Keys sharing hashes passed ---" << std::endl;
+    std::cout << "All result cache tests passed." << std::endl;
+    return 0;
+}
@@ -0,0 +1,156 @@
+#include <stdexcept>
+
+#define BPT_SMALL_SIZE
+#define BPT_TEST
+
+#include "src/sharded.h"
+#include "test/reference.h"
+
+using Tree = RFlowey::ShardedBPT<RFlowey::string<64>, int, String64Hasher, IntHasher>;
+
+const int shard_count = 4;
+
+RFlowey::string<64> key_of(int id) {
+    return RFlowey::string<64>("shard_" + std::to_string(id));
+}
+
+void remove_files(const std::string& db_filename) {
+    for (int i = 0; i < shard_count; ++i) {
+        std::remove((db_filename + "." + std::to_string(i)).c_str());
+    }
+}
+
+void verify_shards(Tree& bpt, const Reference& reference, int key_count, const char* stage) {
+    std::vector<RFlowey::string<64>> keys;
+    for (int id = 0; id < 2 * key_count; ++id) keys.push_back(key_of(id));
+    auto found_many = bpt.find_many(keys);
+    assert(found_many.size() == keys.size());
+    for (int id = 0; id < 2 * key_count; ++id) {
+        std::vector<int> expected = expected_of(reference, id);
+        expect_same(id, expected, values_of(bpt.find(key_of(id))), stage);
+        expect_same(id, expected, values_of(found_many[id]), stage);
+        if (bpt.count(key_of(id)) != expected.size() || bpt.contains(key_of(id)) != !expected.empty()) {
+            fail_mismatch(id, stage);
+        }
+    }
+    bpt.check_structure();
+}
+
+void test_random_against_reference() {
+    std::cout << "--- Single and batched operations against a reference ---" << std::endl;
+    const std::string db_filename = "sharded.dat";
+    remove_files(db_filename);
+    const int key_count = 300;
+    Reference reference;
+    std::mt19937 rng(314159);
+    for (int session = 0; session < 3; ++session) {
+        // batches run on the shard workers in the even sessions and on the calling thread in the odd one
+        Tree bpt(db_filename, shard_count, session % 2 == 0);
+        verify_shards(bpt, reference, key_count, "reopen");
+        for (int round = 0; round < 10; ++round) {
+            for (int op = 0; op < 400; ++op) {
+                int id = rng() % key_count;
+                int value = static_cast<int>(rng() % 50);
+                apply_write(bpt, reference, key_of, id, value, rng() % 3 == 0);
+            }
+            // a batch of new pairs, the same key repeated within it
+            std::vector<RFlowey::string<64>> keys;
+            std::vector<int> values;
+            for (int i = 0; i < 800; ++i) {
+                int id = rng() % key_count;
+                int value = static_cast<int>(rng() % 50);
+                if (reference[id].insert(value).second) {
+                    keys.push_back(key_of(id));
+                    values.push_back(value);
+                }
+            }
+            bpt.insert_many(keys, values);
+            verify_shards(bpt, reference, key_count, "after insert_many");
+            // a batch of erases, about half of them absent
+            keys.clear();
+            values.clear();
+            size_t expected = 0;
+            for (int i = 0; i < 800; ++i) {
+                int id = rng() % key_count;
+                int value = static_cast<int>(rng() % 50);
+                expected += reference[id].erase(value);
+                keys.push_back(key_of(id));
+                values.push_back(value);
+            }
+            assert(bpt.erase_many(keys, values) == expected);
+            verify_shards(bpt, reference, key_count, "after erase_many");
+        }
+        if (session == 1) {
+            bpt.flush();
+        }
+    }
+    remove_files(db_filename);
+    std::cout << "--- Sharded operations passed ---" << std::endl;
+}
+
+void test_keys_spread_over_shards() {
+    std::cout << "--- Keys spread over the shards ---" << std::endl;
+    const std::string db_filename = "sharded_spread.dat";
+    remove_files(db_filename);
+    {
+        Tree bpt(db_filename, shard_count);
+        std::vector<RFlowey::string<64>> keys;
+        std::vector<int> values;
+        for (int id = 0; id < 4000; ++id) {
+            keys.push_back(key_of(id));
+            values.push_back(id);
+        }
+        bpt.insert_many(keys, values);
+        bpt.flush();
+    }
+    // every shard is a tree of its own, holding a fair part of the keys
+    for (int i = 0; i < shard_count; ++i) {
+        RFlowey::BPT<RFlowey::string<64>, int, String64Hasher, IntHasher> shard(db_filename + "." + std::to_string(i));
+        size_t count = 0;
+        for (int id = 0; id < 4000; ++id) {
+            count += shard.count(key_of(id));
+        }
+        assert(count > 4000 / shard_count / 2 && count < 4000 / shard_count * 2);
+    }
+    remove_files(db_filename);
+    std::cout << "--- Spread passed ---" << std::endl;
+}
+
+void test_other_shard_count_is_refused() {
+    std::cout << "--- Reopening with another shard count ---" << std::endl;
+    const std::string db_filename = "sharded_count.dat";
+    remove_files(db_filename);
+    {
+        Tree bpt(db_filename, shard_count);
+        for (int id = 0; id < 100; ++id) bpt.insert(key_of(id), id);
+    }
+    for (size_t other : {static_cast<size_t>(shard_count - 1), static_cast<size_t>(shard_count + 1)}) {
+        bool refused = false;
+        try {
+            Tree bpt(db_filename, other);
+        } catch (const std::runtime_error&) {
+            refused = true;
+        }
+        assert(refused);
+    }
+    {
+        Tree bpt(db_filename, shard_count);
+        for (int id = 0; id < 100; ++id) {
+            auto found = bpt.find(key_of(id));
+            assert(found.size() == 1 && found[0] == id);
+        }
+    }
+    // the refused open with more shards must not have left a file behind
+    std::FILE* extra = std::fopen((db_filename + "." + std::to_string(shard_count)).c_str(), "rb");
+    assert(extra == nullptr);
+    remove_files(db_filename);
+    std::cout << "--- Other shard count passed ---" << std::endl;
+}
+
+int main() {
+    test_random_against_reference();
+    test_keys_spread_over_shards();
+    test_other_shard_count_is_refused();
+    std::cout << "All sharded tests passed." << std::endl;
+    return 0;
+}
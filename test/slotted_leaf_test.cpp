@@ -0,0 +1,228 @@
+#include <stdexcept>
+
+#define BPT_SMALL_SIZE
+#define BPT_TEST
+#define BPT_SLOTTED_LEAF
+
+#include "src/BPT.h"
+#include "test/reference.h"
+
+using key_type = RFlowey::pair<RFlowey::hash_t, RFlowey::hash_t>;
+
+// a value of variable length: its id, which is its hash, and a note of up to 32 characters
+struct Note {
+    int id = 0;
+    RFlowey::string<32> text;
+};
+
+struct NoteHasher {
+    RFlowey::hash_t operator()(const Note& n) const {
+        return static_cast<RFlowey::hash_t>(n.id) + 1;
+    }
+};
+
+namespace RFlowey {
+    // the id, then the characters of the note
+    template<>
+    struct Codec<Note> {
+        static constexpr size_t MAX_SIZE = sizeof(int) + Codec<string<32>>::MAX_SIZE;
+
+        static size_t size(const Note& n) {
+            return sizeof(int) + Codec<string<32>>::size(n.text);
+        }
+        static void write(char* out, const Note& n) {
+            std::memcpy(out, &n.id, sizeof(int));
+            Codec<string<32>>::write(out + sizeof(int), n.text);
+        }
+        static Note read(const char* in, size_t size) {
+            Note n;
+            std::memcpy(&n.id, in, sizeof(int));
+            n.text = Codec<string<32>>::read(in + sizeof(int), size - sizeof(int));
+            return n;
+        }
+    };
+}
+
+struct StringHasher {
+    RFlowey::hash_t operator()(const std::string& s) const {
+        return RFlowey::hash(s);
+    }
+};
+
+template<int N>
+struct StringNHasher {
+    RFlowey::hash_t operator()(const RFlowey::string<N>& s) const {
+        return RFlowey::hash(std::string_view(s.data(), s.length()));
+    }
+};
+
+// keys of 65 to 84 characters that agree on their first 64, so that none survives a cut at 64
+std::string long_key(int id) {
+    return std::string(65 + id % 20, 'k') + std::to_string(id);
+}
+
+void test_leaf_records() {
+    std::cout << "--- Leaf records ---" << std::endl;
+    using Leaf = RFlowey::SlottedLeaf<key_type, RFlowey::pair<std::string, int>>;
+    using Fixed = RFlowey::BPTNode<key_type, RFlowey::pair<RFlowey::string<64>, int>, RFlowey::Leaf>;
+    // the keys of the driver are mostly 10 to 20 characters
+    assert(Leaf::footprint({std::string(15, 'x'), 0}) * 2 < sizeof(Fixed::value_type));
+
+    auto leaf = std::make_unique<Leaf>(1);
+    std::vector<std::pair<key_type, std::string>> expected;
+    auto check = [&] {
+        size_t used = 0;
+        assert(leaf->current_size_ == expected.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            auto entry = leaf->at(i);
+            assert(entry.first == expected[i].first && leaf->key_at(i) == expected[i].first);
+            assert(entry.second.first == expected[i].second && entry.second.second == static_cast<int>(i));
+            used += Leaf::footprint(entry.second);
+        }
+        assert(leaf->used() == used);
+    };
+    auto fill = [&] {
+        for (size_t i = 0; i < expected.size(); ++i) {
+            assert(leaf->replace(i, {expected[i].second, static_cast<int>(i)}));
+        }
+    };
+    // inserted out of order, each after the last key below it
+    for (int k : {5, 1, 9, 3, 7, 2}) {
+        key_type key{static_cast<RFlowey::hash_t>(k), 0};
+        std::string text(k * 3, static_cast<char>('a' + k));
+        leaf->insert_at(leaf->search(key), {key, {text, 0}});
+        auto pos = std::upper_bound(expected.begin(), expected.end(), std::make_pair(key, std::string{}),
+                                    [](const auto& a, const auto& b) { return a.first < b.first; });
+        expected.insert(pos, {key, text});
+    }
+    fill();
+    check();
+    // the records behind an erased one close the gap
+    leaf->erase(2);
+    expected.erase(expected.begin() + 2);
+    fill();
+    check();
+    // a longer record takes the place of a shorter one, a shorter one of a longer one
+    expected[1].second = std::string(40, 'L');
+    expected[3].second = "s";
+    fill();
+    check();
+    size_t long_ones = std::erase_if(expected, [](const auto& e) { return e.second.size() > 10; });
+    assert(leaf->erase_if([](const Leaf::value_type& entry) { return entry.second.first.size() > 10; }) == long_ones);
+    fill();
+    check();
+    // a record too long for a leaf is refused before anything changes
+    bool thrown = false;
+    try {
+        leaf->push_back({{100, 0}, {std::string(Leaf::RECORD_MAX, 'x'), 0}});
+    } catch (const std::length_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+    check();
+    std::cout << "--- Leaf records passed ---" << std::endl;
+}
+
+template<typename Key, typename KeyHash>
+void test_long_keys(const std::string& db_filename, uint32_t seed) {
+    using Tree = RFlowey::BPT<Key, int, KeyHash, IntHasher>;
+    auto key_of = [](int id) { return Key(long_key(id)); };
+    run_sessions<Tree>(db_filename, {.ops = 4000, .key_count = 200, .value_count = 20, .verify_every = 1000}, seed,
+                       key_of, [](Tree& bpt, const Reference&) { bpt.check_structure(); });
+}
+
+void test_long_key_refused() {
+    std::cout << "--- A key too long for a leaf ---" << std::endl;
+    const std::string db_filename = "slotted_refused.dat";
+    std::remove(db_filename.c_str());
+    using Tree = RFlowey::BPT<RFlowey::string<256>, int, StringNHasher<256>, IntHasher>;
+    using Leaf = RFlowey::SlottedLeaf<key_type, RFlowey::pair<RFlowey::string<256>, int>>;
+    RFlowey::string<256> too_long(std::string(Leaf::RECORD_MAX, 'x'));
+    {
+        Tree bpt(db_filename);
+        bpt.insert(RFlowey::string<256>("short"), 1);
+        bool thrown = false;
+        try {
+            bpt.insert(too_long, 2);
+        } catch (const std::length_error&) {
+            thrown = true;
+        }
+        assert(thrown);
+        // none of a batch is applied if one of its keys is too long
+        thrown = false;
+        try {
+            bpt.insert_many({RFlowey::string<256>("batch"), too_long}, {3, 4});
+        } catch (const std::length_error&) {
+            thrown = true;
+        }
+        assert(thrown);
+        bpt.flush();
+        assert(bpt.find(too_long).size() == 0);
+#if !defined(BPT_MEMTABLE) && !defined(BPT_MESSAGE_BUFFER)
+        assert(bpt.find(RFlowey::string<256>("batch")).size() == 0);
+#endif
+        auto found = bpt.find(RFlowey::string<256>("short"));
+        assert(found.size() == 1 && found[0] == 1);
+        bpt.check_structure();
+    }
+    std::remove(db_filename.c_str());
+    std::cout << "--- A key too long for a leaf passed ---" << std::endl;
+}
+
+// upserts that grow and shrink the records in place, or move them when their leaf has no room left
+void test_growing_values() {
+    std::cout << "--- Values of changing length ---" << std::endl;
+    const std::string db_filename = "slotted_values.dat";
+    std::remove(db_filename.c_str());
+    using Tree = RFlowey::BPT<RFlowey::string<64>, Note, String64Hasher, NoteHasher>;
+    auto key_of = [](int k) { return RFlowey::string<64>("note_" + std::to_string(k)); };
+    const int key_count = 30;
+    const int id_count = 20;
+    // key -> id -> length of its note
+    std::map<int, std::map<int, int>> lengths;
+    std::mt19937 rng(8080);
+    auto verify_notes = [&](Tree& bpt, const char* stage) {
+        for (int k = 0; k < key_count; ++k) {
+            std::vector<std::pair<int, std::string>> expected, got;
+            for (auto [id, length] : lengths[k]) expected.emplace_back(id, std::string(length, 'a' + id % 26));
+            auto found = bpt.find(key_of(k));
+            for (size_t i = 0; i < found.size(); ++i) got.emplace_back(found[i].id, found[i].text.get_str());
+            expect_same(k, expected, got, stage);
+        }
+    };
+    for (int session = 0; session < 3; ++session) {
+        Tree bpt(db_filename);
+        verify_notes(bpt, "reopen");
+        for (int op = 0; op < 5000; ++op) {
+            int k = rng() % key_count;
+            int id = rng() % id_count;
+            int length = rng() % 33;
+            Note note{id, RFlowey::string<32>(std::string(length, 'a' + id % 26))};
+            if (rng() % 5 == 0) {
+                bool expected = lengths[k].erase(id) > 0;
+                assert(bpt.erase(key_of(k), note) == expected);
+            } else {
+                bool absent = lengths[k].count(id) == 0;
+                lengths[k][id] = length;
+                assert(bpt.upsert(key_of(k), note) == absent);
+            }
+        }
+        verify_notes(bpt, "end of session");
+        bpt.check_structure();
+    }
+    std::remove(db_filename.c_str());
+    std::cout << "--- Values of changing length passed ---" << std::endl;
+}
+
+int main() {
+    test_leaf_records();
+    test_long_keys<RFlowey::string<96>, StringNHasher<96>>("slotted_string96.dat", 4711);
+#ifndef BPT_MESSAGE_BUFFER
+    // the message buffer keeps whole keys in its pages, so it takes fixed-size ones only
+    test_long_keys<std::string, StringHasher>("slotted_std_string.dat", 4712);
+#endif
+    test_long_key_refused();
+    test_growing_values();
+    std::cout << "All slotted leaf tests passed." << std::endl;
+    return 0;
+}